@@ -0,0 +1,118 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Counters for profiling a generated machine, and a helper that writes them
+ * in the format read back by ragel --profile-use.
+ *
+ * Each machine gets one ragel_profile. The states array is indexed by the
+ * state id used in the generated code. The trans array has one entry per
+ * transition range, with the state and keys filled in once and the count
+ * incremented. Counts of zero are not written. Machine names are written
+ * as a single field, so a name that is empty or holds whitespace or control
+ * characters is refused.
+ */
+
+#ifndef _RAGEL_PROFILE_H
+#define _RAGEL_PROFILE_H
+
+#include <stdio.h>
+#include <ctype.h>
+
+struct ragel_profile_trans
+{
+	long state;
+	long long low_key;
+	long long high_key;
+	unsigned long long count;
+};
+
+struct ragel_profile
+{
+	const char *machine;
+
+	long num_states;
+	unsigned long long *states;
+
+	long num_trans;
+	struct ragel_profile_trans *trans;
+
+	long num_actions;
+	unsigned long long *actions;
+
+	unsigned long long eof_exits;
+	unsigned long long error_exits;
+};
+
+/* Write the counts of num machines. Returns zero on success, or -1 if a
+ * machine name cannot be written or writing failed. Nothing is written when
+ * a name is refused. */
+static inline int ragel_profile_dump( FILE *out,
+		const struct ragel_profile *profiles, int num )
+{
+	int m;
+	long i;
+	const char *c;
+
+	for ( m = 0; m < num; m++ ) {
+		c = profiles[m].machine;
+		if ( c == 0 || *c == 0 )
+			return -1;
+		for ( ; *c != 0; c++ ) {
+			if ( !isgraph( (unsigned char)*c ) )
+				return -1;
+		}
+	}
+
+	fprintf( out, "ragel-profile 1\n" );
+	for ( m = 0; m < num; m++ ) {
+		const struct ragel_profile *p = &profiles[m];
+
+		fprintf( out, "machine %s %ld\n", p->machine, p->num_states );
+
+		for ( i = 0; i < p->num_states; i++ ) {
+			if ( p->states[i] != 0 )
+				fprintf( out, "state %ld %llu\n", i, p->states[i] );
+		}
+
+		for ( i = 0; i < p->num_trans; i++ ) {
+			const struct ragel_profile_trans *t = &p->trans[i];
+			if ( t->count != 0 ) {
+				fprintf( out, "trans %ld %lld %lld %llu\n", t->state,
+						t->low_key, t->high_key, t->count );
+			}
+		}
+
+		for ( i = 0; i < p->num_actions; i++ ) {
+			if ( p->actions[i] != 0 )
+				fprintf( out, "action %ld %llu\n", i, p->actions[i] );
+		}
+
+		fprintf( out, "eof %llu\n", p->eof_exits );
+		fprintf( out, "error %llu\n", p->error_exits );
+		fprintf( out, "end\n" );
+	}
+
+	return ferror( out ) ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,577 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libfsm/ragel.h>
+#include "graphcache.h"
+#include "inputdata.h"
+#include "parsedata.h"
+#include "parsetree.h"
+#include "version.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+
+/* Tags that open each node in the hash, so different trees with the same
+ * contents hash differently. */
+enum GraphHashTag
+{
+	HT_VarDef = 1,
+	HT_MachineDef,
+	HT_Join,
+	HT_Expression,
+	HT_Term,
+	HT_FactorWithAug,
+	HT_FactorWithRep,
+	HT_FactorWithNeg,
+	HT_Factor,
+	HT_Range,
+	HT_Literal,
+	HT_RegExpr,
+	HT_ReItem,
+	HT_ReOrBlock,
+	HT_ReOrItem
+};
+
+static const char graphCacheMagic[8] = { 'R', 'L', 'G', 'R', 'A', 'P', 'H', '2' };
+
+void GraphHash::add( const void *data, long len )
+{
+	const unsigned char *p = (const unsigned char*)data;
+	key.append( (const char*)data, len );
+	for ( long i = 0; i < len; i++ ) {
+		value ^= p[i];
+		value *= 1099511628211ULL;
+	}
+}
+
+void GraphHash::add( long long v )
+{
+	add( &v, sizeof(v) );
+}
+
+void GraphHash::add( const char *s )
+{
+	long len = strlen( s );
+	add( len );
+	add( s, len );
+}
+
+bool VarDef::hashTree( ParseData *pd, GraphHash &hash )
+{
+	/* Named local errors get transferred into the graph. */
+	if ( pd->localErrDict.find( name ) != 0 )
+		return false;
+
+	for ( Vector<VarDef*>::Iter def = hash.defStack; def.lte(); def++ ) {
+		if ( *def == this )
+			return false;
+	}
+
+	hash.add( HT_VarDef );
+	hash.defStack.append( this );
+	bool success = machineDef->hashTree( pd, hash );
+	hash.defStack.remove( hash.defStack.length() - 1 );
+	return success;
+}
+
+bool MachineDef::hashTree( ParseData *pd, GraphHash &hash )
+{
+	if ( type != JoinType )
+		return false;
+
+	hash.add( HT_MachineDef );
+	return join->hashTree( pd, hash );
+}
+
+bool Join::hashTree( ParseData *pd, GraphHash &hash )
+{
+	/* Joins of more than one expression need named entry points. */
+	if ( exprList.length() != 1 )
+		return false;
+
+	hash.add( HT_Join );
+	return exprList.head->hashTree( pd, hash );
+}
+
+bool Expression::hashTree( ParseData *pd, GraphHash &hash )
+{
+	hash.add( HT_Expression );
+	hash.add( type );
+	switch ( type ) {
+		case OrType:
+		case IntersectType:
+		case SubtractType:
+		case StrongSubtractType:
+			return expression->hashTree( pd, hash ) && term->hashTree( pd, hash );
+		case TermType:
+			return term->hashTree( pd, hash );
+		case BuiltinType:
+			hash.add( builtin );
+			return true;
+	}
+	return false;
+}
+
+bool Term::hashTree( ParseData *pd, GraphHash &hash )
+{
+	hash.add( HT_Term );
+	hash.add( type );
+	switch ( type ) {
+		case ConcatType:
+			return term->hashTree( pd, hash ) && factorWithAug->hashTree( pd, hash );
+		case FactorWithAugType:
+			return factorWithAug->hashTree( pd, hash );
+		case RightStartType:
+		case RightFinishType:
+		case LeftType:
+			/* These assign priorities. */
+			return false;
+	}
+	return false;
+}
+
+bool FactorWithAug::hashTree( ParseData *pd, GraphHash &hash )
+{
+	if ( actions.length() > 0 || priorityAugs.length() > 0 || labels.size() > 0 ||
+			epsilonLinks.length() > 0 || conditions.length() > 0 )
+		return false;
+
+	hash.add( HT_FactorWithAug );
+	return factorWithRep->hashTree( pd, hash );
+}
+
+bool FactorWithRep::hashTree( ParseData *pd, GraphHash &hash )
+{
+	hash.add( HT_FactorWithRep );
+	hash.add( type );
+	switch ( type ) {
+		case StarType:
+		case OptionalType:
+		case PlusType:
+		case ExactType:
+		case MaxType:
+		case MinType:
+		case RangeType:
+			hash.add( lowerRep );
+			hash.add( upperRep );
+			return factorWithRep->hashTree( pd, hash );
+		case FactorWithNegType:
+			return factorWithNeg->hashTree( pd, hash );
+		case StarStarType:
+			/* Assigns priorities. */
+			return false;
+	}
+	return false;
+}
+
+bool FactorWithNeg::hashTree( ParseData *pd, GraphHash &hash )
+{
+	hash.add( HT_FactorWithNeg );
+	hash.add( type );
+	switch ( type ) {
+		case NegateType:
+		case CharNegateType:
+			return factorWithNeg->hashTree( pd, hash );
+		case FactorType:
+			return factor->hashTree( pd, hash );
+	}
+	return false;
+}
+
+bool Factor::hashTree( ParseData *pd, GraphHash &hash )
+{
+	hash.add( HT_Factor );
+	hash.add( type );
+	switch ( type ) {
+		case LiteralType:
+			return literal->hashTree( hash );
+		case RangeType:
+			return range->hashTree( hash );
+		case OrExprType:
+			return reItem->hashTree( hash );
+		case RegExprType:
+			return regExpr->hashTree( hash );
+		case ReferenceType:
+			return varDef->hashTree( pd, hash );
+		case ParenType:
+			return join->hashTree( pd, hash );
+		case LongestMatchType:
+		case NfaRep:
+		case NfaWrap:
+		case CondStar:
+		case CondPlus:
+			return false;
+	}
+	return false;
+}
+
+bool Range::hashTree( GraphHash &hash )
+{
+	hash.add( HT_Range );
+	hash.add( caseIndep );
+	return lowerLit->hashTree( hash ) && upperLit->hashTree( hash );
+}
+
+bool Literal::hashTree( GraphHash &hash )
+{
+	hash.add( HT_Literal );
+	hash.add( type );
+	hash.add( neg );
+	hash.add( data.length() );
+	hash.add( data.data, data.length() );
+	return true;
+}
+
+bool RegExpr::hashTree( GraphHash &hash )
+{
+	/* Left recursive list, hash it iteratively. */
+	hash.add( HT_RegExpr );
+	hash.add( caseInsensitive );
+	for ( RegExpr *re = this; re->type == RecurseItem; re = re->regExpr ) {
+		hash.add( RecurseItem );
+		if ( !re->item->hashTree( hash ) )
+			return false;
+	}
+	hash.add( Empty );
+	return true;
+}
+
+bool ReItem::hashTree( GraphHash &hash )
+{
+	hash.add( HT_ReItem );
+	hash.add( type );
+	hash.add( star );
+	switch ( type ) {
+		case Data:
+			hash.add( data.length() );
+			hash.add( data.data, data.length() );
+			return true;
+		case Dot:
+			return true;
+		case OrBlock:
+		case NegOrBlock:
+			return orBlock->hashTree( hash );
+	}
+	return false;
+}
+
+bool ReOrBlock::hashTree( GraphHash &hash )
+{
+	hash.add( HT_ReOrBlock );
+	for ( ReOrBlock *block = this; block->type == RecurseItem; block = block->orBlock ) {
+		hash.add( RecurseItem );
+		if ( !block->item->hashTree( hash ) )
+			return false;
+	}
+	hash.add( Empty );
+	return true;
+}
+
+bool ReOrItem::hashTree( GraphHash &hash )
+{
+	hash.add( HT_ReOrItem );
+	hash.add( type );
+	switch ( type ) {
+		case Data:
+			hash.add( data.length() );
+			hash.add( data.data, data.length() );
+			return true;
+		case Range:
+			hash.add( lower );
+			hash.add( upper );
+			return true;
+	}
+	return false;
+}
+
+bool GraphCache::makeKey( ParseData *pd, VarDef *varDef, GraphHash &hash )
+{
+	/* Names below that are referenced get entry points during the walk. */
+	for ( NameVect::Iter child = pd->curNameInst->childVect; child.lte(); child++ ) {
+		if ( (*child)->anyRefsRec() )
+			return false;
+	}
+
+	KeyOps *keyOps = pd->fsmCtx->keyOps;
+	hash.add( "ragel " VERSION );
+	hash.add( keyOps->isSigned );
+	hash.add( keyOps->minKey.getVal() );
+	hash.add( keyOps->maxKey.getVal() );
+	hash.add( pd->id->minimizeLevel );
+	hash.add( pd->id->minimizeOpt );
+
+	return varDef->hashTree( pd, hash );
+}
+
+std::string GraphCache::entryPath( const GraphHash &hash )
+{
+	char name[32];
+	sprintf( name, "%016llx.rlg", hash.value );
+	return dir + "/" + name;
+}
+
+/* Can the graph be written out with states, keys and targets alone? */
+static bool plainGraph( FsmAp *fsm )
+{
+	if ( fsm->startState == 0 || fsm->entryPoints.length() > 0 )
+		return false;
+
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		if ( st->nfaOut != 0 || st->outCondSpace != 0 ||
+				st->toStateActionTable.length() > 0 ||
+				st->fromStateActionTable.length() > 0 ||
+				st->outActionTable.length() > 0 ||
+				st->outPriorTable.length() > 0 ||
+				st->errActionTable.length() > 0 ||
+				st->eofActionTable.length() > 0 )
+			return false;
+
+		for ( TransList::Iter trans = st->outList; trans.lte(); trans++ ) {
+			if ( !trans->plain() )
+				return false;
+
+			TransDataAp *tdap = trans->tdap();
+			if ( tdap->actionTable.length() > 0 || tdap->priorTable.length() > 0 ||
+					tdap->lmActionTable.length() > 0 )
+				return false;
+		}
+	}
+	return true;
+}
+
+static void appendInt( std::string &buf, long long v )
+{
+	buf.append( (const char*)&v, sizeof(v) );
+}
+
+static bool readInt( const std::string &buf, long &pos, long long &v )
+{
+	if ( pos + (long)sizeof(v) > (long)buf.size() )
+		return false;
+	memcpy( &v, buf.data() + pos, sizeof(v) );
+	pos += sizeof(v);
+	return true;
+}
+
+/* Write the graph out as the start state first, then the other states in
+ * list order, each with its final flag and its transitions in key order. */
+static void encodeGraph( std::string &buf, const GraphHash &hash, FsmAp *fsm )
+{
+	AvlMap<StateAp*, long long> stateIds;
+	Vector<StateAp*> order;
+	stateIds.insert( fsm->startState, 0 );
+	order.append( fsm->startState );
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		if ( st != fsm->startState ) {
+			stateIds.insert( st, order.length() );
+			order.append( st );
+		}
+	}
+
+	buf.append( graphCacheMagic, sizeof(graphCacheMagic) );
+	appendInt( buf, hash.value );
+	appendInt( buf, hash.key.size() );
+	buf.append( hash.key );
+	appendInt( buf, order.length() );
+
+	for ( Vector<StateAp*>::Iter st = order; st.lte(); st++ ) {
+		StateAp *state = *st;
+		appendInt( buf, state->isFinState() ? 1 : 0 );
+		appendInt( buf, state->outList.length() );
+		for ( TransList::Iter trans = state->outList; trans.lte(); trans++ ) {
+			StateAp *toState = trans->tdap()->toState;
+			appendInt( buf, trans->lowKey.getVal() );
+			appendInt( buf, trans->highKey.getVal() );
+			appendInt( buf, toState == 0 ? -1 : stateIds.find( toState )->value );
+		}
+	}
+}
+
+/* Rebuild a graph from an entry. Returns null if the entry is damaged or was
+ * made for another key. Two keys with the same hash share an entry name, so
+ * the whole key is compared, not just the hash. */
+static FsmAp *decodeGraph( ParseData *pd, const std::string &buf, const GraphHash &hash )
+{
+	long pos = sizeof(graphCacheMagic);
+	long long value, keyLen, numStates;
+	if ( buf.size() < sizeof(graphCacheMagic) ||
+			memcmp( buf.data(), graphCacheMagic, sizeof(graphCacheMagic) ) != 0 ||
+			!readInt( buf, pos, value ) || (unsigned long long)value != hash.value ||
+			!readInt( buf, pos, keyLen ) || keyLen != (long long)hash.key.size() ||
+			keyLen > (long long)buf.size() - pos ||
+			buf.compare( pos, keyLen, hash.key ) != 0 )
+		return 0;
+
+	pos += keyLen;
+	if ( !readInt( buf, pos, numStates ) || numStates < 1 ||
+			numStates > (long long)buf.size() )
+		return 0;
+
+	KeyOps *keyOps = pd->fsmCtx->keyOps;
+
+	/* State zero is the start state. */
+	FsmAp *fsm = FsmAp::emptyFsm( pd->fsmCtx );
+	StateAp **states = new StateAp*[numStates];
+	states[0] = fsm->startState;
+	for ( long long s = 1; s < numStates; s++ )
+		states[s] = fsm->addState();
+
+	bool valid = true;
+	for ( long long s = 0; valid && s < numStates; s++ ) {
+		long long isFinal, numTrans;
+		if ( !readInt( buf, pos, isFinal ) || !readInt( buf, pos, numTrans ) ) {
+			valid = false;
+			break;
+		}
+
+		if ( isFinal )
+			fsm->setFinState( states[s] );
+
+		/* Transitions are attached in key order. */
+		Key prevHigh = keyOps->minKey;
+		for ( long long t = 0; t < numTrans; t++ ) {
+			long long low, high, target;
+			if ( !readInt( buf, pos, low ) || !readInt( buf, pos, high ) ||
+					!readInt( buf, pos, target ) || target < -1 || target >= numStates )
+			{
+				valid = false;
+				break;
+			}
+
+			Key lowKey( low ), highKey( high );
+			if ( keyOps->gt( lowKey, highKey ) || keyOps->gt( highKey, keyOps->maxKey ) ||
+					( t > 0 && keyOps->le( lowKey, prevHigh ) ) ||
+					keyOps->lt( lowKey, keyOps->minKey ) )
+			{
+				valid = false;
+				break;
+			}
+
+			fsm->attachNewTrans( states[s], target < 0 ? 0 : states[target], lowKey, highKey );
+			prevHigh = highKey;
+		}
+	}
+
+	delete[] states;
+
+	if ( !valid ) {
+		delete fsm;
+		return 0;
+	}
+
+	return fsm;
+}
+
+static bool readFile( const std::string &path, std::string &buf )
+{
+	FILE *file = fopen( path.c_str(), "rb" );
+	if ( file == 0 )
+		return false;
+
+	char block[4096];
+	size_t n;
+	while ( ( n = fread( block, 1, sizeof(block), file ) ) > 0 )
+		buf.append( block, n );
+
+	bool failed = ferror( file ) != 0;
+	fclose( file );
+	return !failed;
+}
+
+FsmAp *GraphCache::load( ParseData *pd, const GraphHash &hash )
+{
+	std::string buf;
+
+	if ( keepInMemory ) {
+		bool found = false;
+		lock.lock();
+		MemoryMapEl *el = memory.find( hash.key );
+		if ( el != 0 ) {
+			buf = el->value;
+			found = true;
+		}
+		lock.unlock();
+
+		if ( found )
+			return decodeGraph( pd, buf, hash );
+	}
+
+	if ( dir.size() == 0 || !readFile( entryPath( hash ), buf ) )
+		return 0;
+
+	/* The file may hold another key with the same hash. Only a match is
+	 * kept in memory. */
+	FsmAp *fsm = decodeGraph( pd, buf, hash );
+	if ( fsm != 0 && keepInMemory ) {
+		lock.lock();
+		if ( memory.find( hash.key ) == 0 )
+			memory.insert( hash.key, buf );
+		lock.unlock();
+	}
+
+	return fsm;
+}
+
+void GraphCache::store( ParseData *pd, const GraphHash &hash, FsmAp *fsm )
+{
+	if ( !plainGraph( fsm ) )
+		return;
+
+	std::string buf;
+	encodeGraph( buf, hash, fsm );
+
+	if ( keepInMemory ) {
+		lock.lock();
+		MemoryMapEl *el = memory.find( hash.key );
+		if ( el != 0 )
+			el->value = buf;
+		else
+			memory.insert( hash.key, buf );
+		lock.unlock();
+	}
+
+	if ( dir.size() == 0 )
+		return;
+
+	/* Write to a private file, then move it into place so concurrent runs
+	 * never see a partial entry. */
+	std::string path = entryPath( hash );
+	std::stringstream tmp;
+	tmp << path << ".tmp." << getpid() << "." << (void*)pd;
+
+	FILE *file = fopen( tmp.str().c_str(), "wb" );
+	if ( file == 0 )
+		return;
+
+	fwrite( buf.data(), 1, buf.size(), file );
+
+	bool failed = ferror( file ) != 0;
+	if ( fclose( file ) != 0 || failed ) {
+		unlink( tmp.str().c_str() );
+		return;
+	}
+
+	if ( rename( tmp.str().c_str(), path.c_str() ) != 0 )
+		unlink( tmp.str().c_str() );
+}
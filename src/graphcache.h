@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GRAPHCACHE_H
+#define _GRAPHCACHE_H
+
+#include <string>
+#include "vector.h"
+#include "avlmap.h"
+#include "workers.h"
+
+struct ParseData;
+struct VarDef;
+struct FsmAp;
+
+/* Hash of a definition's parse tree, along with the settings that affect the
+ * graph it builds. FNV-1a, 64 bits. The hash only names an entry; the bytes
+ * hashed are kept as the key, which an entry must match in full. */
+struct GraphHash
+{
+	GraphHash() : value(14695981039346656037ULL) {}
+
+	void add( const void *data, long len );
+	void add( long long v );
+	void add( const char *s );
+
+	unsigned long long value;
+	std::string key;
+
+	/* Definitions currently being hashed. A reference back into one of
+	 * these is left to the walk to report. */
+	Vector<VarDef*> defStack;
+};
+
+/*
+ * Cache of definition graphs, on disk and optionally in memory. Only
+ * definitions that build plain graphs are cached: no actions, priorities,
+ * conditions, labels, entry points or scanners. Those depend on state outside
+ * the definition.
+ */
+struct GraphCache
+{
+	/* An empty dir keeps entries in memory only. */
+	GraphCache( const std::string &dir, bool keepInMemory )
+		: dir(dir), keepInMemory(keepInMemory) {}
+
+	/* Make the key for a definition. Returns false if it cannot be cached.
+	 * Must be called in the definition's name scope. */
+	static bool makeKey( ParseData *pd, VarDef *varDef, GraphHash &hash );
+
+	FsmAp *load( ParseData *pd, const GraphHash &hash );
+	void store( ParseData *pd, const GraphHash &hash, FsmAp *fsm );
+
+	std::string dir;
+	bool keepInMemory;
+
+private:
+	typedef AvlMap<std::string, std::string> MemoryMap;
+	typedef AvlMapEl<std::string, std::string> MemoryMapEl;
+
+	std::string entryPath( const GraphHash &hash );
+
+	/* Encoded entries by full key, shared by the sections being compiled. */
+	MemoryMap memory;
+	WorkLock lock;
+};
+
+#endif
@@ -30,11 +30,14 @@
 #include "version.h"
 #include "pcheck.h"
 #include "nragel.h"
+#include "workers.h"
 #include <libfsm/dot.h>
 
 #include <colm/colm.h>
+#include <colm/tree.h>
 
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <stdio.h>
 #include <iostream>
@@ -46,9 +49,13 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #if defined(HAVE_SYS_WAIT_H)
 #include <sys/wait.h>
 #endif
+#if defined(HAVE_SYS_MMAN_H) || defined(HAVE_MEMFD_CREATE)
+#include <sys/mman.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -92,6 +99,30 @@ InputData::~InputData()
 	if ( histogramFn != 0 )
 		::free( (void*)histogramFn );
 
+	if ( histogramCorpusFn != 0 )
+		::free( (void*)histogramCorpusFn );
+
+	if ( timeReport != 0 )
+		delete timeReport;
+
+	if ( timeReportFn != 0 )
+		::free( (void*)timeReportFn );
+
+	if ( profileFn != 0 )
+		::free( (void*)profileFn );
+
+	if ( profile != 0 )
+		delete profile;
+
+	releaseInput();
+
+	/* A build run by the watcher or a batch shares its cache. */
+	if ( graphCache != 0 && watcher == 0 && batchFile == 0 )
+		delete graphCache;
+
+	if ( batchManifest != 0 )
+		::free( (void*)batchManifest );
+
 	if ( histogram != 0 )
 		delete[] histogram;
 
@@ -125,6 +156,7 @@ void InputData::createOutputStream()
 
 		/* Create the filter on the output and open it. */
 		outFilter = new output_filter( outputFileName );
+		outFilter->reindentTables = !noReindentTables;
 
 		/* Open the output stream, attaching it to the filter. */
 		outStream = new ostream( outFilter );
@@ -250,6 +282,9 @@ void InputData::writeStatement( CodeGenData *cgd, InputLoc &loc, int nargs,
 			cgd->red->id->stats() << "fsm-states\t" << cgd->redFsm->stateList.length() << std::endl;
 		}
 
+		if ( cgd->red->id->profile != 0 )
+			cgd->red->id->checkProfile( cgd, loc );
+
 		cgd->collectReferences();
 		cgd->writeData();
 		cgd->statsSummary();
@@ -314,8 +349,11 @@ void InputData::writeOutput( InputItem *ii )
 	switch ( ii->type ) {
 		case InputItem::Write: {
 			CodeGenData *cgd = ii->pd->cgd;
+			double start = timeNow();
 			writeStatement( cgd, ii->loc, ii->writeArgs.size(),
 					ii->writeArgs, generateDot, hostLang );
+			ii->pd->reportTime( "codegen", start, ii->writeArgs.size() > 0 ?
+					ii->writeArgs[0] : std::string() );
 			break;
 		}
 		case InputItem::HostData: {
@@ -327,10 +365,14 @@ void InputData::writeOutput( InputItem *ii )
 						(*hostLang->genLineDirective)( *outStream, !noLineDirectives, ii->loc.line, ii->loc.fileName );
 					}
 						
-					*outStream << ii->data.str();
+					writeHostData( *outStream, ii );
 					break;
 				case Translated:
 					openHostBlock( '@', this, *outStream, inputFileName, ii->loc.line );
+					if ( ii->spanOffset >= 0 ) {
+						checkInputMap();
+						endHostSpan( ii );
+					}
 					translatedHostData( *outStream, ii->data.str() );
 					*outStream << "}@";
 					break;
@@ -350,6 +392,8 @@ void InputData::closeOutput()
 	if ( outputFileName != 0 ) {
 		delete outStream;
 		delete outFilter;
+		outStream = 0;
+		outFilter = 0;
 	}
 }
 
@@ -382,6 +426,163 @@ void InputData::processDot()
 	closeOutput();
 }
 
+/* Build the machine for a section. Does not write any output, so sections can
+ * be built in any order. Failure is decided by the errors of the section
+ * alone. */
+bool InputData::buildSection( ParseData *pd )
+{
+	pd->prepared = true;
+	pd->prepareSuccess = false;
+
+	FsmRes res = pd->prepareMachineGen( 0, hostLang );
+
+	/* Compute exports from the export definitions. */
+	pd->makeExports();
+
+	return res.success() && pd->sectionErrors == 0;
+}
+
+/* Reduce a built section for code generation. Always on the main thread, in
+ * section order. */
+bool InputData::reduceSection( ParseData *pd )
+{
+	pd->generateReduced( inputFileName, codeStyle, *outStream, hostLang );
+
+	if ( errorCount > 0 )
+		return false;
+
+	pd->prepareSuccess = true;
+	return true;
+}
+
+bool InputData::prepareSection( ParseData *pd )
+{
+	if ( !buildSection( pd ) )
+		return false;
+
+	if ( errorCount > 0 )
+		return false;
+
+	return reduceSection( pd );
+}
+
+/* Builds one section on a worker. What the build writes to cerr is kept until
+ * the sections are replayed in order. Sections after one that has failed are
+ * not started, a serial run never gets to them. */
+struct BuildSectionItem
+:
+	public WorkItem
+{
+	BuildSectionItem( InputData *id, ParseData *pd, long pos,
+			WorkLock *lock, long *firstFailure )
+	:
+		id(id), pd(pd), pos(pos), lock(lock),
+		firstFailure(firstFailure), success(false)
+	{}
+
+	void work()
+	{
+		lock->lock();
+		bool skip = *firstFailure < pos;
+		lock->unlock();
+
+		if ( skip )
+			return;
+
+		WorkCapture::setThread( &diagnostics );
+		try {
+			success = id->buildSection( pd );
+		}
+		catch ( ... ) {
+			WorkCapture::setThread( 0 );
+			throw;
+		}
+		WorkCapture::setThread( 0 );
+
+		if ( !success ) {
+			lock->lock();
+			if ( pos < *firstFailure )
+				*firstFailure = pos;
+			lock->unlock();
+		}
+	}
+
+	InputData *id;
+	ParseData *pd;
+	long pos;
+	WorkLock *lock;
+	long *firstFailure;
+	bool success;
+	std::ostringstream diagnostics;
+};
+
+/* Sections only compile in parallel when nothing in the compile writes to the
+ * shared statistics and analysis results. The order of those reports must
+ * follow the order of the sections. */
+bool InputData::parallelSections()
+{
+	return numJobs > 1 && !generateDot && !printStatistics &&
+			!checkBreadth && condsCheckDepth < 0 &&
+			!checkPriorInteraction && stateLimit == 0;
+}
+
+/* Each section has its own parse data and fsm context, so the machines can be
+ * built independently. Reduction and code generation analysis run after, on
+ * this thread, in section order. The diagnostics of each section are replayed
+ * in that order too, and the replay stops at the first section that failed,
+ * so the errors are those of a serial run. Output is still written by the
+ * flush, in input item order. */
+void InputData::prepareSectionsParallel()
+{
+	WorkLock lock;
+	long firstFailure = LONG_MAX;
+
+	Vector<BuildSectionItem*> sections;
+	WorkItemVect items;
+	for ( ParseDataList::Iter pd = parseDataList; pd.lte(); pd++ ) {
+		if ( pd->instanceList.length() > 0 && !pd->prepared ) {
+			BuildSectionItem *item = new BuildSectionItem( this, pd,
+					sections.length(), &lock, &firstFailure );
+			sections.append( item );
+			items.append( item );
+		}
+	}
+
+	/* Workers count their errors against their sections. The global count is
+	 * rebuilt from those as the sections are replayed. */
+	int errorsBefore = errorCount;
+	try {
+		WorkCapture capture( std::cerr );
+		runWorkItems( items, numJobs );
+	}
+	catch ( const AbortCompile & ) {
+		for ( long i = 0; i < sections.length(); i++ ) {
+			std::cerr << sections[i]->diagnostics.str();
+			delete sections[i];
+		}
+		throw;
+	}
+	errorCount = errorsBefore;
+
+	bool failed = false;
+	for ( long i = 0; i < sections.length(); i++ ) {
+		BuildSectionItem *item = sections[i];
+		if ( !failed && i <= firstFailure ) {
+			std::cerr << item->diagnostics.str();
+			errorCount += item->pd->sectionErrors;
+
+			if ( !item->success || errorCount > 0 || !reduceSection( item->pd ) )
+				failed = true;
+		}
+		else {
+			/* Not reached by a serial run. Leave it for checkLastRef, which
+			 * stops at the failure first. */
+			item->pd->prepared = false;
+		}
+		delete item;
+	}
+}
+
 bool InputData::checkLastRef( InputItem *ii )
 {
 	if ( generateDot )
@@ -408,20 +609,11 @@ bool InputData::checkLastRef( InputItem *ii )
 				ii->parser->terminateParser();
 #endif
 
-			FsmRes res = pd->prepareMachineGen( 0, hostLang );
-
-			/* Compute exports from the export definitions. */
-			pd->makeExports();
-
-			if ( !res.success() )
-				return false;
-
-			if ( errorCount > 0 )
-				return false;
-
-			pd->generateReduced( inputFileName, codeStyle, *outStream, hostLang );
+			/* May have already been done by the parallel section compile. */
+			if ( !pd->prepared )
+				prepareSection( pd );
 
-			if ( errorCount > 0 )
+			if ( !pd->prepareSuccess )
 				return false;
 		}
 
@@ -495,10 +687,190 @@ void InputData::flushRemaining()
 void InputData::makeTranslateOutputFileName()
 {
 	origOutputFileName = outputFileName;
-	outputFileName = fileNameFromStem( outputFileName, ".ri" );
+	if ( saveTemps || noIntermediate || !makeTranslateMemFile() )
+		outputFileName = fileNameFromStem( outputFileName, ".ri" );
 	genOutputFileName = outputFileName;
 }
 
+/* A name that opens the descriptor again, or null on systems without
+ * procfs. */
+static char *procFdName( int fd, int mode )
+{
+	std::stringstream path;
+	path << "/proc/self/fd/" << fd;
+
+	if ( access( path.str().c_str(), mode ) != 0 )
+		return 0;
+
+	char *fileName = new char[path.str().size() + 1];
+	strcpy( fileName, path.str().c_str() );
+	return fileName;
+}
+
+/* Put the intermediate in an anonymous memory file instead of on disk. Both
+ * the frontend and rlhc open it by its /proc/self/fd name, which also works
+ * in forked children since they inherit the descriptor. */
+bool InputData::makeTranslateMemFile()
+{
+#if defined(HAVE_MEMFD_CREATE)
+	int fd = memfd_create( "ragel-intermediate", 0 );
+	if ( fd < 0 )
+		return false;
+
+	char *fileName = procFdName( fd, R_OK | W_OK );
+	if ( fileName == 0 ) {
+		close( fd );
+		return false;
+	}
+
+	translateFd = fd;
+	outputFileName = fileName;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void InputData::closeTranslateMemFile()
+{
+	if ( translateFd >= 0 ) {
+		close( translateFd );
+		translateFd = -1;
+	}
+}
+
+/* Room for the intermediate between the frontend and rlhc. */
+#define TRANSLATE_PIPE_SIZE ( 1024 * 1024 )
+
+/* Connect the frontend to rlhc with a pipe and start rlhc reading from it in
+ * a child process. The frontend and rlhc are colm programs and are not known
+ * to be reentrant, so they are never run side by side in one process. The
+ * pipe buffer is the queue between the stages. It bounds how far the frontend
+ * can run ahead, and the memory the intermediate takes. */
+bool InputData::startTranslatePipeline()
+{
+#if defined(HAVE_SYS_WAIT_H)
+	int fds[2];
+	if ( pipe( fds ) != 0 )
+		return false;
+
+#if defined(F_SETPIPE_SZ)
+	fcntl( fds[1], F_SETPIPE_SZ, TRANSLATE_PIPE_SIZE );
+#endif
+
+	char *readName = procFdName( fds[0], R_OK );
+	char *writeName = procFdName( fds[1], W_OK );
+	if ( readName == 0 || writeName == 0 ) {
+		delete[] readName;
+		delete[] writeName;
+		close( fds[0] );
+		close( fds[1] );
+		return false;
+	}
+
+	origOutputFileName = outputFileName;
+	genOutputFileName = readName;
+	delete[] readName;
+
+	rlhcStart = timeNow();
+	pid_t pid = fork();
+	if ( pid < 0 ) {
+		delete[] writeName;
+		close( fds[0] );
+		close( fds[1] );
+		return false;
+	}
+
+	if ( pid == 0 ) {
+		/* The child keeps only the read end, so it sees the end of the
+		 * intermediate once the frontend closes its side. */
+		close( fds[1] );
+
+		/* rlhc <input> <output> */
+		const char *argv[] = { "rlhc",
+				genOutputFileName.c_str(),
+				origOutputFileName.c_str(), 0 };
+		int code = runRlhc( 3, argv );
+
+		/* If rlhc stopped early, keep reading so a frontend that is still
+		 * writing does not wait on a full pipe. */
+		char buf[4096];
+		while ( read( fds[0], buf, sizeof(buf) ) > 0 )
+			;
+		exit( code );
+	}
+
+	close( fds[0] );
+	rlhcPid = pid;
+	pipeWriteFd = fds[1];
+	outputFileName = writeName;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void InputData::closeTranslatePipe( int &fd )
+{
+	if ( fd >= 0 ) {
+		close( fd );
+		fd = -1;
+	}
+}
+
+/* Run the frontend in this process while rlhc translates in the child. */
+int InputData::runTranslatePipeline()
+{
+#if defined(HAVE_SYS_WAIT_H)
+	double start = timeNow();
+
+	/* If rlhc dies, writes to the pipe fail instead of ending ragel. */
+	void (*prevPipe)( int ) = signal( SIGPIPE, SIG_IGN );
+
+	int es = -1;
+	try {
+		es = runFrontend( 0, 0 );
+	}
+	catch ( const AbortCompile &ac ) {
+		es = ac.code;
+	}
+
+	/* The frontend may have stopped with the output still open. Close every
+	 * write end so rlhc sees the end of the intermediate. */
+	if ( outFilter != 0 && outFilter->is_open() )
+		outFilter->close();
+	closeTranslatePipe( pipeWriteFd );
+
+	if ( timeReport != 0 )
+		timeReport->add( "", "frontend", inputFileName, timeNow() - start );
+
+	int status = 0;
+	int code = -1;
+	waitpid( rlhcPid, &status, 0 );
+	rlhcPid = -1;
+	signal( SIGPIPE, prevPipe );
+
+	if ( WIFSIGNALED(status) )
+		error() << "rlhc stopped by signal: " << WTERMSIG(status) << std::endl;
+	else
+		code = WEXITSTATUS( status );
+
+	/* Wall time of the child, which includes waiting on the frontend. */
+	if ( timeReport != 0 )
+		timeReport->add( "", "rlhc", origOutputFileName, timeNow() - rlhcStart );
+
+	/* Whatever rlhc made of a partial intermediate is not kept. */
+	if ( es != 0 ) {
+		unlink( origOutputFileName.c_str() );
+		return es;
+	}
+
+	return code;
+#else
+	return -1;
+#endif
+}
+
 #ifdef WITH_RAGEL_KELBT
 void InputData::parseKelbt()
 {
@@ -575,15 +947,11 @@ bool InputData::parseReduce()
 	TopLevel *topLevel = new TopLevel( frontendSections, this, hostLang,
 			minimizeLevel, minimizeOpt );
 
-	/* Check input file. File is actually opened by colm code. We don't
-	 * need to perform the check if in libragel since it comes in via a
-	 * string. */
-	if ( input == 0 ) {
-		ifstream *inFile = new ifstream( inputFileName );
-		if ( ! inFile->is_open() )
-			error() << "could not open " << inputFileName << " for reading" << endp;
-		delete inFile;
-	}
+	/* Map the input file. The file is also read by the colm code, but host
+	 * data is taken from the mapping. We don't need it if in libragel since
+	 * the input comes in via a string. */
+	if ( input == 0 && !readInput( inputFileName ) )
+		abortCompile( 1 );
 
 	if ( errorCount )
 		return false;
@@ -594,7 +962,10 @@ bool InputData::parseReduce()
 	lastFlush = inputItems.head;
 
 
+	double start = timeNow();
 	topLevel->reduceFile( "rlparse", inputFileName );
+	if ( timeReport != 0 )
+		timeReport->add( "", "parse", inputFileName, timeNow() - start );
 
 	if ( errorCount )
 		return false;
@@ -617,12 +988,16 @@ bool InputData::processReduce()
 		openOutput();
 
 		bool success = parseReduce();
-		if ( success )
+		if ( success ) {
+			if ( parallelSections() )
+				prepareSectionsParallel();
+
 			flushRemaining();
+		}
 
 		closeOutput();
 
-		if ( !success && outputFileName != 0 )
+		if ( !success && outputFileName != 0 && translateFd < 0 && pipeWriteFd < 0 )
 			unlink( outputFileName );
 
 		return success;
@@ -661,6 +1036,20 @@ void InputData::usage()
 "   --rlhc               Show the rlhc command used to compile\n"
 "   --save-temps         Do not delete intermediate file during compilation\n"
 "   --no-intermediate    Disable call to rlhc, leave behind intermediate\n"
+"   --in-process         Run the frontend and rlhc in the ragel process\n"
+"   --pipeline           Run rlhc alongside the frontend, translating the\n"
+"                        intermediate as it is generated\n"
+"   --jobs=N             Compile independent machine sections on N threads\n"
+"   --graph-cache=DIR    Store built definition graphs in DIR and reuse them\n"
+"   --batch[=MANIFEST]   Compile all the input files given, and the input and\n"
+"                        output pairs listed in MANIFEST, in one process,\n"
+"                        or with --jobs in child processes\n"
+"   --watch              Stay resident and rebuild when the input or any\n"
+"                        file it includes changes\n"
+"   --profile-use=FILE   Read execution counts taken from instrumented\n"
+"                        generated code\n"
+"   --time-report[=FILE] Report the time spent in each phase, per section and\n"
+"                        definition. Text to stderr, or JSON to FILE\n"
 "error reporting format:\n"
 "   --error-format=gnu   file:line:column: message (default)\n"
 "   --error-format=msvc  file(line,column): message\n"
@@ -692,6 +1081,9 @@ void InputData::usage()
 "   ragel-js             JavaScript  -T0 -T1 -F0 -F1\n"
 "line directives:\n"
 "   -L                   Inhibit writing of #line directives\n"
+"indentation:\n"
+"   --no-reindent-tables Write lines of table data as generated, without\n"
+"                        re-indenting them\n"
 "code style:\n"
 "   -T0                  Binary search (default)\n"
 "   -T1                  Binary search with expanded actions \n"
@@ -712,10 +1104,14 @@ void InputData::usage()
 "                                of the machine (depth D from start state).\n"
 "   --state-limit=L              Report fail if number of states exceeds this\n"
 "                                during compilation.\n"
+"   --mem-limit=BYTES            Fail a machine when its graphs take more than\n"
+"                                this much memory. Accepts K, M and G suffixes.\n"
 "   --breadth-check=E1,E2,..     Report breadth cost of named entry points and\n"
 "                                the start state.\n"
 "   --input-histogram=FN         Input char histogram for breadth check. If\n"
 "                                unspecified a flat histogram is used.\n"
+"   --input-histogram-from=FN    Compute the breadth check histogram from the\n"
+"                                bytes of a sample input file.\n"
 "testing:\n"
 "   --kelbt-frontend        Compile using original ragel + kelbt frontend\n"
 "                           Requires ragel be built with ragel + kelbt support\n"
@@ -1082,6 +1478,29 @@ void InputData::parseArgs( int argc, const char **argv )
 					condsCheckDepth = strtol( eq, 0, 10 );
 				else if ( strcmp( arg, "state-limit" ) == 0 )
 					stateLimit = strtol( eq, 0, 10 );
+				else if ( strcmp( arg, "mem-limit" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting '=bytes' for mem-limit" << endl;
+					else {
+						char *end = 0;
+						errno = 0;
+						long value = strtol( eq, &end, 10 );
+						int shift = 0;
+						switch ( *end ) {
+							case 'k': case 'K': shift = 10; end += 1; break;
+							case 'm': case 'M': shift = 20; end += 1; break;
+							case 'g': case 'G': shift = 30; end += 1; break;
+						}
+
+						/* Nothing may follow the suffix and the bytes must
+						 * fit in a long. */
+						if ( errno != 0 || *end != 0 || value < 1 ||
+								value > ( LONG_MAX >> shift ) )
+							error() << "invalid value for mem-limit" << endl;
+						else
+							memLimit = value << shift;
+					}
+				}
 
 				else if ( strcmp( arg, "breadth-check" ) == 0 ) {
 					char *ptr = 0;
@@ -1096,10 +1515,71 @@ void InputData::parseArgs( int argc, const char **argv )
 				}
 				else if ( strcmp( arg, "input-histogram" ) == 0 )
 					histogramFn = strdup(eq);
+				else if ( strcmp( arg, "input-histogram-from" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting --input-histogram-from=FILE" << endp;
+					histogramCorpusFn = strdup(eq);
+				}
 				else if ( strcmp( arg, "var-backend" ) == 0 )
 					forceVar = true;
 				else if ( strcmp( arg, "no-fork" ) == 0 )
 					noFork = true;
+				else if ( strcmp( arg, "in-process" ) == 0 )
+					inProcess = true;
+				else if ( strcmp( arg, "pipeline" ) == 0 )
+					pipeline = true;
+				else if ( strcmp( arg, "no-reindent-tables" ) == 0 )
+					noReindentTables = true;
+				else if ( strcmp( arg, "jobs" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting '=value' for jobs" << endl;
+					else {
+						numJobs = strtol( eq, 0, 10 );
+						if ( numJobs < 1 )
+							error() << "invalid value for jobs" << endl;
+					}
+				}
+				else if ( strcmp( arg, "graph-cache" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting '=dir' for graph-cache" << endl;
+					else if ( watcher == 0 && batchFile == 0 ) {
+						/* A build run by the watcher or a batch keeps the
+						 * cache it was given. */
+						if ( graphCache != 0 )
+							delete graphCache;
+						graphCache = new GraphCache( eq, false );
+					}
+				}
+				else if ( strcmp( arg, "watch" ) == 0 )
+					watch = true;
+				else if ( strcmp( arg, "batch" ) == 0 ) {
+					batch = true;
+					if ( eq != 0 ) {
+						if ( batchManifest != 0 )
+							::free( (void*)batchManifest );
+						batchManifest = strdup( eq );
+					}
+				}
+				else if ( strcmp( arg, "profile-use" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting --profile-use=FILE" << endp;
+					if ( profileFn != 0 )
+						::free( (void*)profileFn );
+					profileFn = strdup( eq );
+				}
+				else if ( strcmp( arg, "time-report" ) == 0 ) {
+					if ( timeReport == 0 )
+						timeReport = new TimeReport;
+					if ( eq != 0 ) {
+						if ( timeReportFn != 0 )
+							::free( (void*)timeReportFn );
+						timeReportFn = strdup( eq );
+					}
+
+					/* The frontend must run in this process for its timings
+					 * to reach the report. */
+					noFork = true;
+				}
 				else {
 					error() << "--" << pc.paramArg << 
 							" is an invalid argument" << endl;
@@ -1177,8 +1657,15 @@ void InputData::parseArgs( int argc, const char **argv )
 			/* It is interpreted as an input file. */
 			if ( *pc.curArg == 0 )
 				error() << "a zero length input file name was given" << endl;
-			else if ( inputFileName != 0 )
-				error() << "more than one input file name was given" << endl;
+			else if ( inputFileName != 0 ) {
+				/* Only a batch takes more than one. Checked once all the
+				 * arguments are in. */
+				BatchFile file;
+				file.input = pc.curArg;
+				file.code = 0;
+				file.seconds = 0;
+				batchFiles.push_back( file );
+			}
 			else {
 				/* OK, Remember the filename. */
 				inputFileName = pc.curArg;
@@ -1226,6 +1713,82 @@ void InputData::loadHistogram()
 	}
 }
 
+void InputData::loadProfile()
+{
+	ifstream in( profileFn );
+	if ( !in.is_open() )
+		error() << "profile read: failed to open file: " << profileFn << endp;
+
+	std::string err;
+	profile = new Profile;
+	if ( !profile->read( in, err ) )
+		error() << "profile read: " << profileFn << ": " << err << endp;
+}
+
+/* A profile is only of use to the code generators if it was taken from the
+ * machine as it is now. Check that the machine is there with the same number
+ * of states. */
+void InputData::checkProfile( CodeGenData *cgd, const InputLoc &loc )
+{
+	const ProfileMachine *machine = profile->find( cgd->fsmName );
+	if ( machine == 0 ) {
+		warning( loc ) << "profile " << profileFn << " has no counts for machine " <<
+				cgd->fsmName << endl;
+		return;
+	}
+
+	long numStates = cgd->redFsm->stateList.length();
+	if ( (long)machine->states.size() != numStates ) {
+		warning( loc ) << "profile " << profileFn << " has " << machine->states.size() <<
+				" states for machine " << cgd->fsmName << ", which now has " <<
+				numStates << ", the profile is out of date" << endl;
+		return;
+	}
+
+	if ( printStatistics ) {
+		stats() << "profile-hot-states\t" << machine->hotStates( 0.9 ) <<
+				"/" << numStates << std::endl;
+	}
+}
+
+/* Count the bytes of a sample of real input. Every value gets one count to
+ * start, so symbols missing from the sample keep a small share. */
+void InputData::histogramFromCorpus()
+{
+	const int alphsize = 256;
+
+	ifstream in( histogramCorpusFn, ios::in | ios::binary );
+	if ( !in.is_open() )
+		error() << "histogram corpus: failed to open file: " << histogramCorpusFn << endp;
+
+	long long counts[alphsize];
+	for ( int i = 0; i < alphsize; i++ )
+		counts[i] = 1;
+
+	long long total = alphsize;
+	char block[65536];
+	while ( true ) {
+		in.read( block, sizeof(block) );
+		std::streamsize n = in.gcount();
+		if ( n <= 0 )
+			break;
+
+		for ( std::streamsize i = 0; i < n; i++ )
+			counts[(unsigned char)block[i]] += 1;
+		total += n;
+	}
+
+	if ( in.bad() )
+		error() << "histogram corpus: error reading " << histogramCorpusFn << endp;
+
+	if ( total == alphsize )
+		error() << "histogram corpus: " << histogramCorpusFn << " is empty" << endp;
+
+	histogram = new double[alphsize];
+	for ( int i = 0; i < alphsize; i++ )
+		histogram[i] = (double)counts[i] / (double)total;
+}
+
 void InputData::defaultHistogram()
 {
 	/* Flat histogram. */
@@ -1239,10 +1802,17 @@ void InputData::defaultHistogram()
 void InputData::checkArgs()
 {
 	/* Require an input file. If we use standard in then we won't have a file
-	 * name on which to base the output. */
-	if ( inputFileName == 0 )
+	 * name on which to base the output. A batch may take its inputs from the
+	 * manifest. */
+	if ( inputFileName == 0 && !( batch && batchManifest != 0 ) )
 		error() << "no input file given" << endl;
 
+	if ( !batch && batchFiles.size() > 0 )
+		error() << "more than one input file name was given" << endl;
+
+	if ( batch && watch )
+		error() << "--batch and --watch cannot be used together" << endl;
+
 	/* Bail on argument processing errors. */
 	if ( errorCount > 0 )
 		abortCompile( 1 );
@@ -1258,39 +1828,171 @@ void InputData::checkArgs()
 	if ( !frontendSpecified )
 		frontend = ReduceBased;
 
+	if ( histogramFn != 0 && histogramCorpusFn != 0 )
+		error() << "--input-histogram and --input-histogram-from cannot be used together" << endp;
+
+	if ( profileFn != 0 )
+		loadProfile();
+
 	if ( checkBreadth ) {
 		if ( histogramFn != 0 )
 			loadHistogram();
+		else if ( histogramCorpusFn != 0 )
+			histogramFromCorpus();
 		else
 			defaultHistogram();
 	}
 }
 
-char *InputData::readInput( const char *inputFileName )
+/* Map the whole input file once. The frontend writes host data straight from
+ * the mapping, so it is not copied per input item. Falls back to reading the
+ * file where mmap is not available. */
+bool InputData::readInput( const char *inputFileName )
 {
+	int fd = open( inputFileName, O_RDONLY );
+	if ( fd < 0 ) {
+		error() << "could not open " << inputFileName << " for reading" << endl;
+		return false;
+	}
+
 	struct stat st;
-	int res = stat( inputFileName, &st );
-	if ( res != 0 ) {
+	if ( fstat( fd, &st ) != 0 ) {
 		error() << inputFileName << ": stat failed: " << strerror(errno) << endl;
-		return 0;
+		::close( fd );
+		return false;
 	}
 
-	std::ifstream in( inputFileName );
-	if ( !in.is_open() ) {
-		error() << inputFileName << ": could not open in force-libragel mode";
-		return 0;
+	releaseInput();
+
+	inputMapLength = st.st_size;
+	if ( inputMapLength == 0 ) {
+		::close( fd );
+		return true;
 	}
 
-	char *input = new char[st.st_size+1];
-	in.read( input, st.st_size );
-	if ( in.gcount() != st.st_size ) {
-		error() << inputFileName << ": could not read in force-libragel mode";
-		delete[] input;
-		return 0;
+#if defined(HAVE_SYS_MMAN_H)
+	void *map = mmap( 0, inputMapLength, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( map != MAP_FAILED ) {
+		/* Kept open to check the file has not shrunk under the map. */
+		inputFd = fd;
+		inputMap = (const char*)map;
+		inputMapped = true;
+		return true;
+	}
+#endif
+
+	char *data = new char[inputMapLength];
+	long got = 0;
+	while ( got < inputMapLength ) {
+		ssize_t r = read( fd, data + got, inputMapLength - got );
+		if ( r <= 0 )
+			break;
+		got += r;
+	}
+	::close( fd );
+
+	if ( got != inputMapLength ) {
+		error() << inputFileName << ": could not read" << endl;
+		delete[] data;
+		inputMapLength = 0;
+		return false;
+	}
+
+	inputMap = data;
+	return true;
+}
+
+void InputData::releaseInput()
+{
+	if ( inputMap != 0 ) {
+#if defined(HAVE_SYS_MMAN_H)
+		if ( inputMapped )
+			munmap( (void*)inputMap, inputMapLength );
+		else
+#endif
+			delete[] inputMap;
+	}
+
+	if ( inputFd >= 0 )
+		::close( inputFd );
+
+	inputFd = -1;
+	inputMap = 0;
+	inputMapLength = 0;
+	inputMapped = false;
+}
+
+/* A mapped file that shrinks raises SIGBUS when the pages it lost are read.
+ * Checked before a span of the map is started and before spans are
+ * written. */
+void InputData::checkInputMap()
+{
+	struct stat st;
+	if ( inputFd >= 0 && ( fstat( inputFd, &st ) != 0 ||
+			st.st_size < inputMapLength ) )
+	{
+		error() << inputFileName << ": file changed while it was read" << endp;
+	}
+}
+
+/* Copy the span of an item into its data. Text written to the data while the
+ * span was open came after the span, so it is kept behind it. */
+void InputData::endHostSpan( InputItem *ii )
+{
+	std::string rest = ii->data.str();
+	ii->data.str( "" );
+	ii->data.write( inputMap + ii->spanOffset, ii->spanLength );
+	ii->data << rest;
+	ii->spanOffset = -1;
+	ii->spanLength = 0;
+}
+
+/* Add host data to an input item. While each token sits in the mapped input
+ * right after the last, the item only extends its span. Anything else, such
+ * as text colm pushed back into the stream or text a host frontend makes up
+ * (a null location), moves the item over to copying. */
+void InputData::appendHostData( InputItem *ii, const colm_location *loc,
+		const char *data, long length )
+{
+	if ( ii->spanOffset >= 0 && ii->data.tellp() > 0 )
+		endHostSpan( ii );
+
+	if ( ii->spanOffset >= 0 || ii->data.tellp() <= 0 ) {
+		long offset = loc != 0 ? loc->byte : -1;
+		bool inMap = inputMap != 0 && offset >= 0 &&
+				offset + length <= inputMapLength;
+
+		if ( inMap && ii->spanOffset < 0 )
+			checkInputMap();
+
+		inMap = inMap && memcmp( inputMap + offset, data, length ) == 0;
+
+		if ( inMap && ii->spanOffset < 0 ) {
+			ii->spanOffset = offset;
+			ii->spanLength = length;
+			return;
+		}
+
+		if ( inMap && ii->spanOffset + ii->spanLength == offset ) {
+			ii->spanLength += length;
+			return;
+		}
+
+		if ( ii->spanOffset >= 0 )
+			endHostSpan( ii );
 	}
-	input[st.st_size] = 0;
 
-	return input;
+	ii->data.write( data, length );
+}
+
+/* The span comes first, then anything written to the data after it. */
+void InputData::writeHostData( std::ostream &out, InputItem *ii )
+{
+	if ( ii->spanOffset >= 0 ) {
+		checkInputMap();
+		out.write( inputMap + ii->spanOffset, ii->spanLength );
+	}
+	out << ii->data.str();
 }
 
 int InputData::runFrontend( int argc, const char **argv )
@@ -1317,7 +2019,7 @@ int InputData::runRlhc( int argc, const char **argv )
 int InputData::runJob( const char *what, IdProcess idProcess, int argc, const char **argv )
 {
 #if defined(HAVE_SYS_WAIT_H)
-	if ( !noFork ) {
+	if ( !noFork && !inProcess ) {
 		pid_t pid = fork();
 
 		if ( pid == 0 ) {
@@ -1343,7 +2045,14 @@ int InputData::main( int argc, const char **argv )
 	int code = 0;
 	try {
 		parseArgs( argc, argv );
+		if ( batchFile != 0 )
+			useBatchFile();
 		checkArgs();
+		if ( batch && batchFile == 0 )
+			return batchLoop( &InputData::main, argc, argv );
+		if ( watch && watcher == 0 )
+			return watchLoop( &InputData::main, argc, argv );
+
 		if ( !generateDot )
 			makeDefaultFileName();
 
@@ -1354,6 +2063,7 @@ int InputData::main( int argc, const char **argv )
 		code = ac.code;
 	}
 
+	writeTimeReport();
 	return code;
 }
 
@@ -1362,24 +2072,376 @@ int InputData::rlhcMain( int argc, const char **argv )
 	int code = 0;
 	try {
 		parseArgs( argc, argv );
+		if ( batchFile != 0 )
+			useBatchFile();
 		checkArgs();
+		if ( batch && batchFile == 0 )
+			return batchLoop( &InputData::rlhcMain, argc, argv );
+		if ( watch && watcher == 0 )
+			return watchLoop( &InputData::rlhcMain, argc, argv );
+
 		makeDefaultFileName();
+
+		if ( pipeline && !noFork && !inProcess && !saveTemps &&
+				!noIntermediate && startTranslatePipeline() )
+		{
+			code = runTranslatePipeline();
+			writeTimeReport();
+			return code;
+		}
+
 		makeTranslateOutputFileName();
 
 		int es = runJob( "frontend", &InputData::runFrontend, 0, 0 );
 
-		if ( es != 0 )
+		if ( es != 0 ) {
+			closeTranslateMemFile();
 			return es;
+		}
 
-		/* rlhc <input> <output> */
-		const char *_argv[] = { "rlhc",
-				genOutputFileName.c_str(),
-				origOutputFileName.c_str(), 0 };
+		if ( !noIntermediate ) {
+			/* rlhc <input> <output> */
+			const char *_argv[] = { "rlhc",
+					genOutputFileName.c_str(),
+					origOutputFileName.c_str(), 0 };
 
-		return runJob( "rlhc", &InputData::runRlhc, 3, _argv );
+			double start = timeNow();
+			code = runJob( "rlhc", &InputData::runRlhc, 3, _argv );
+			if ( timeReport != 0 )
+				timeReport->add( "", "rlhc", origOutputFileName, timeNow() - start );
+		}
 	}
 	catch ( const AbortCompile &ac ) {
 		code = ac.code;
 	}
+
+	closeTranslateMemFile();
+
+	writeTimeReport();
 	return code;
 }
+
+void InputData::writeTimeReport()
+{
+	if ( timeReport == 0 )
+		return;
+
+	if ( timeReportFn == 0 ) {
+		timeReport->writeText( stats() );
+		return;
+	}
+
+	ofstream out( timeReportFn );
+	if ( !out.is_open() ) {
+		error() << "could not open " << timeReportFn << " for writing" << endl;
+		return;
+	}
+
+	timeReport->writeJson( out, inputFileName );
+}
+
+static void addWatchFile( WatchFileVect &files, const char *name )
+{
+	for ( WatchFileVect::const_iterator wf = files.begin(); wf != files.end(); wf++ ) {
+		if ( wf->name == name )
+			return;
+	}
+
+	WatchFile file;
+	file.name = name;
+	file.exists = false;
+	file.mtime = 0;
+	file.size = 0;
+
+	struct stat st;
+	if ( stat( name, &st ) == 0 ) {
+		file.exists = true;
+		file.mtime = st.st_mtime;
+		file.size = st.st_size;
+	}
+
+	files.push_back( file );
+}
+
+static bool watchFilesChanged( const WatchFileVect &files )
+{
+	for ( WatchFileVect::const_iterator wf = files.begin(); wf != files.end(); wf++ ) {
+		struct stat st;
+		bool exists = stat( wf->name.c_str(), &st ) == 0;
+		if ( exists != wf->exists )
+			return true;
+		if ( exists && ( st.st_mtime != wf->mtime || st.st_size != wf->size ) )
+			return true;
+	}
+	return false;
+}
+
+/* Stay resident, rebuilding whenever the input or a file it pulled in
+ * changes. Each build runs on a fresh InputData, in this process so it can
+ * report the files it read. Definition graphs are kept in memory between
+ * builds, so only the definitions that changed are walked again. */
+int InputData::watchLoop( IdProcess entry, int argc, const char **argv )
+{
+	if ( graphCache == 0 )
+		graphCache = new GraphCache( "", true );
+	else
+		graphCache->keepInMemory = true;
+
+	WatchFileVect files;
+	while ( true ) {
+		InputData *build = new InputData( hostLang, frontendSections, rlhcSections );
+		build->watcher = this;
+		build->graphCache = graphCache;
+		build->noFork = true;
+
+		int code = (build->*entry)( argc, argv );
+
+		files.clear();
+		addWatchFile( files, inputFileName );
+		for ( Vector<const char**>::Iter fns = build->streamFileNames; fns.lte(); fns++ ) {
+			for ( const char **fn = *fns; *fn != 0; fn++ )
+				addWatchFile( files, *fn );
+		}
+
+		delete build;
+
+		info() << inputFileName << ": " << ( code == 0 ? "built" : "build failed" ) <<
+				", watching " << files.size() << " files" << endl;
+
+		while ( !watchFilesChanged( files ) )
+			usleep( 250000 );
+	}
+
+	return 0;
+}
+
+/* Each line of a manifest names an input file and, optionally, its output
+ * file. Blank lines and lines starting with # are skipped. */
+void InputData::readBatchManifest()
+{
+	ifstream manifest( batchManifest );
+	if ( !manifest.is_open() )
+		error() << "could not open batch manifest " << batchManifest << endp;
+
+	std::string line;
+	int lineNum = 0;
+	while ( std::getline( manifest, line ) ) {
+		lineNum += 1;
+
+		std::istringstream fields( line );
+		BatchFile file;
+		if ( !( fields >> file.input ) || file.input[0] == '#' )
+			continue;
+
+		fields >> file.output;
+
+		std::string extra;
+		if ( fields >> extra ) {
+			error() << batchManifest << ":" << lineNum <<
+					": expecting an input and an optional output file" << endl;
+			continue;
+		}
+
+		file.code = 0;
+		file.seconds = 0;
+		batchFiles.push_back( file );
+	}
+}
+
+/* Called on the build for one file of a batch, after it has parsed the
+ * shared arguments. */
+void InputData::useBatchFile()
+{
+	inputFileName = batchFile->input.c_str();
+
+	/* The output comes from the batch entry alone. A -o in the shared
+	 * arguments was given to the first entry by the batch. */
+	if ( outputFileName != 0 ) {
+		delete[] outputFileName;
+		outputFileName = 0;
+	}
+
+	if ( !batchFile->output.empty() ) {
+		char *fileName = new char[batchFile->output.size() + 1];
+		strcpy( fileName, batchFile->output.c_str() );
+		outputFileName = fileName;
+	}
+
+	/* The batch runs the files in parallel, not the sections in a file. */
+	batch = false;
+	batchFiles.clear();
+	numJobs = 1;
+
+	/* Timings are reported per file by the batch. */
+	if ( timeReport != 0 ) {
+		delete timeReport;
+		timeReport = 0;
+	}
+}
+
+struct BatchItem
+:
+	public WorkItem
+{
+	BatchItem( InputData *id, InputData::IdProcess entry, int argc,
+			const char **argv, BatchFile *file )
+	:
+		id(id), entry(entry), argc(argc), argv(argv), file(file) {}
+
+	void work()
+	{
+		InputData *build = new InputData( id->hostLang,
+				id->frontendSections, id->rlhcSections );
+		build->batchFile = file;
+		build->graphCache = id->graphCache;
+		build->noFork = true;
+
+		double start = timeNow();
+		file->code = (build->*entry)( argc, argv );
+		file->seconds = timeNow() - start;
+
+		delete build;
+	}
+
+	InputData *id;
+	InputData::IdProcess entry;
+	int argc;
+	const char **argv;
+	BatchFile *file;
+};
+
+/* Compile the files of a batch in forked children, up to numJobs at once. The
+ * frontends are colm programs and are not known to be reentrant, so they are
+ * never run side by side on threads. Each child reports through its exit
+ * code. Returns false if children cannot be forked. */
+bool InputData::batchForked( IdProcess entry, int argc, const char **argv )
+{
+#if defined(HAVE_SYS_WAIT_H)
+	std::vector<pid_t> pids( batchFiles.size(), 0 );
+	std::vector<double> starts( batchFiles.size(), 0 );
+	size_t next = 0;
+	int running = 0;
+
+	while ( next < batchFiles.size() || running > 0 ) {
+		while ( running < numJobs && next < batchFiles.size() ) {
+			BatchFile *file = &batchFiles[next];
+			starts[next] = timeNow();
+
+			pid_t pid = fork();
+			if ( pid == 0 ) {
+				BatchItem item( this, entry, argc, argv, file );
+				item.work();
+				exit( file->code == 0 ? 0 : 1 );
+			}
+
+			if ( pid < 0 ) {
+				/* Out of processes. Compile it here while the others
+				 * run. */
+				BatchItem item( this, entry, argc, argv, file );
+				item.work();
+			}
+			else {
+				pids[next] = pid;
+				running += 1;
+			}
+			next += 1;
+		}
+
+		if ( running == 0 )
+			continue;
+
+		int status = 0;
+		pid_t pid = waitpid( -1, &status, 0 );
+		if ( pid < 0 )
+			break;
+
+		for ( size_t i = 0; i < pids.size(); i++ ) {
+			if ( pids[i] == pid ) {
+				BatchFile *file = &batchFiles[i];
+				file->seconds = timeNow() - starts[i];
+				if ( WIFSIGNALED(status) ) {
+					error() << file->input << ": stopped by signal: " <<
+							WTERMSIG(status) << std::endl;
+					file->code = 1;
+				}
+				else {
+					file->code = WEXITSTATUS( status );
+				}
+				pids[i] = 0;
+				running -= 1;
+				break;
+			}
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* Compile every file of a batch. Each file is built on a fresh InputData,
+ * from the same arguments. With one job, the files are compiled in this
+ * process, startup is paid once, and definition graphs are shared through an
+ * in-memory graph cache. With more, they are compiled in forked children. */
+int InputData::batchLoop( IdProcess entry, int argc, const char **argv )
+{
+	if ( inputFileName != 0 ) {
+		BatchFile file;
+		file.input = inputFileName;
+		file.code = 0;
+		file.seconds = 0;
+		batchFiles.insert( batchFiles.begin(), file );
+	}
+
+	/* The -o names the output of the one input file on the command line.
+	 * Files from the manifest give their own. */
+	if ( outputFileName != 0 ) {
+		if ( batchFiles.size() > 1 )
+			error() << "-o cannot be used with more than one input file" << endp;
+		if ( batchFiles.size() == 1 )
+			batchFiles[0].output = outputFileName;
+	}
+
+	if ( batchManifest != 0 )
+		readBatchManifest();
+
+	if ( errorCount > 0 )
+		abortCompile( 1 );
+
+	if ( batchFiles.size() == 0 )
+		error() << "no input files given for the batch" << endp;
+
+	if ( graphCache == 0 )
+		graphCache = new GraphCache( "", true );
+	else
+		graphCache->keepInMemory = true;
+
+	double start = timeNow();
+	if ( numJobs <= 1 || batchFiles.size() <= 1 ||
+			!batchForked( entry, argc, argv ) )
+	{
+		for ( size_t i = 0; i < batchFiles.size(); i++ ) {
+			BatchItem item( this, entry, argc, argv, &batchFiles[i] );
+			item.work();
+		}
+	}
+	double seconds = timeNow() - start;
+
+	int failed = 0;
+	for ( BatchFileVect::iterator file = batchFiles.begin(); file != batchFiles.end(); file++ ) {
+		info() << file->input << ": " << ( file->code == 0 ? "ok" : "failed" ) <<
+				" in " << std::fixed << std::setprecision(3) << file->seconds << "s" << endl;
+
+		if ( file->code != 0 )
+			failed += 1;
+
+		if ( timeReport != 0 )
+			timeReport->add( "", "batch", file->input, file->seconds );
+	}
+
+	info() << "batch: " << batchFiles.size() << " files, " << failed << " failed in " <<
+			std::fixed << std::setprecision(3) << seconds << "s" << endl;
+
+	writeTimeReport();
+	return failed > 0 ? 1 : 0;
+}
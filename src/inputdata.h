@@ -24,6 +24,9 @@
 #define _INPUT_DATA
 
 #include "nragel.h"
+#include "graphcache.h"
+#include "timereport.h"
+#include "profile.h"
 #include <libfsm/gendata.h>
 #include <iostream>
 #include <sstream>
@@ -36,6 +39,7 @@ struct CondAp;
 struct ActionTable;
 struct Section;
 struct LangFuncs;
+struct colm_location;
 
 void translatedHostData( ostream &out, const string &data );
 
@@ -46,7 +50,9 @@ struct InputItem
 		section(0),
 		pd(0),
 		parser(0),
-		processed(false)
+		processed(false),
+		spanOffset(-1),
+		spanLength(0)
 	{}
 
 	enum Type {
@@ -66,6 +72,11 @@ struct InputItem
 	InputLoc loc;
 	bool processed;
 
+	/* Host data that lies contiguously in the mapped input file is kept as a
+	 * span of the mapping rather than copied into data. */
+	long spanOffset;
+	long spanLength;
+
 	InputItem *prev, *next;
 };
 
@@ -167,6 +178,29 @@ struct IncludeRec
 
 };
 
+/* A file a watched build depends on, and what it looked like then. */
+struct WatchFile
+{
+	std::string name;
+	bool exists;
+	time_t mtime;
+	off_t size;
+};
+
+typedef std::vector<WatchFile> WatchFileVect;
+
+/* One input of a batch, where its output goes, and how it went. An empty
+ * output means the default name for the host language. */
+struct BatchFile
+{
+	std::string input;
+	std::string output;
+	int code;
+	double seconds;
+};
+
+typedef std::vector<BatchFile> BatchFileVect;
+
 struct InputData
 :
 	public FsmGbl
@@ -192,6 +226,7 @@ struct InputData
 		machineName(0),
 		generateDot(false),
 		noLineDirectives(false),
+		noReindentTables(false),
 		maxTransitions(LONG_MAX),
 		numSplitPartitions(0),
 		rlhc(false),
@@ -204,13 +239,36 @@ struct InputData
 		condsCheckDepth(-1),
 		transSpanDepth(6),
 		stateLimit(0),
+		memLimit(0),
 		checkBreadth(0),
 		varBackend(false),
 		histogramFn(0),
+		histogramCorpusFn(0),
 		histogram(0),
 		input(0),
+		inputMap(0),
+		inputMapLength(0),
+		inputMapped(false),
+		inputFd(-1),
 		forceVar(false),
 		noFork(false),
+		inProcess(false),
+		translateFd(-1),
+		pipeline(false),
+		pipeWriteFd(-1),
+		rlhcPid(-1),
+		rlhcStart(0),
+		numJobs(1),
+		graphCache(0),
+		watch(false),
+		watcher(0),
+		batch(false),
+		batchManifest(0),
+		batchFile(0),
+		timeReport(0),
+		timeReportFn(0),
+		profileFn(0),
+		profile(0),
 		utf8BomPresent(false)
 	{}
 
@@ -272,6 +330,7 @@ struct InputData
 	bool generateDot;
 
 	bool noLineDirectives;
+	bool noReindentTables;
 
 	long maxTransitions;
 	int numSplitPartitions;
@@ -291,20 +350,81 @@ struct InputData
 	long condsCheckDepth;
 	long transSpanDepth;
 	long stateLimit;
+	long memLimit;
 	bool checkBreadth;
 
 	bool varBackend;
 
 	const char *histogramFn;
+	const char *histogramCorpusFn;
 	double *histogram;
 
 	const char *input;
 
+	/* The whole input file, mapped by readInput. */
+	const char *inputMap;
+	long inputMapLength;
+	bool inputMapped;
+	int inputFd;
+
 	Vector<const char**> streamFileNames;
 
 	bool forceVar;
 	bool noFork;
 
+	/* Set by --in-process. Runs the frontend and rlhc of a translated language
+	 * in the ragel process instead of in child processes. */
+	bool inProcess;
+
+	/* Anonymous memory file holding the intermediate for rlhc, or -1 when
+	 * the intermediate is written to disk. */
+	int translateFd;
+
+	/* Set by --pipeline. The frontend writes the intermediate to a pipe that
+	 * rlhc reads from in a child process. */
+	bool pipeline;
+	int pipeWriteFd;
+	long rlhcPid;
+	double rlhcStart;
+
+	/* Number of threads to compile independent sections on. */
+	int numJobs;
+
+	/* Held while a section on a worker adds to the global error count. */
+	WorkLock errorLock;
+
+	/* Set by --graph-cache. Reuses definition graphs across runs. */
+	GraphCache *graphCache;
+
+	/* Set by --watch. Stay resident and rebuild when the input changes. Each
+	 * build runs on its own InputData, which points back at the watcher. */
+	bool watch;
+	InputData *watcher;
+
+	/* Set by --batch. Compiles every input given, and those listed in the
+	 * manifest, in this process or, with --jobs, in forked children. Each
+	 * file is compiled on its own InputData, which points at its entry in
+	 * batchFiles. */
+	bool batch;
+	const char *batchManifest;
+	BatchFileVect batchFiles;
+	BatchFile *batchFile;
+	void readBatchManifest();
+	void useBatchFile();
+
+	/* Set by --time-report. Written as text to the statistics stream, or as
+	 * JSON to timeReportFn if given. */
+	TimeReport *timeReport;
+	const char *timeReportFn;
+	void writeTimeReport();
+
+	/* Set by --profile-use. Execution counts from instrumented generated
+	 * code, checked against each machine as its data is written. */
+	const char *profileFn;
+	Profile *profile;
+	void loadProfile();
+	void checkProfile( CodeGenData *cgd, const InputLoc &loc );
+
 	/* Did the input file have a byte order mark? */
 	bool utf8BomPresent;
 
@@ -312,6 +432,11 @@ struct InputData
 	void verifyWritesHaveData();
 
 	void makeTranslateOutputFileName();
+	bool makeTranslateMemFile();
+	void closeTranslateMemFile();
+	bool startTranslatePipeline();
+	int runTranslatePipeline();
+	void closeTranslatePipe( int &fd );
 	void flushRemaining();
 	void makeFirstInputItem();
 	void writeStatement( CodeGenData *cgd, InputLoc &loc, int nargs,
@@ -324,6 +449,11 @@ struct InputData
 	void generateReduced();
 	void prepareSingleMachine();
 	void prepareAllMachines();
+	bool prepareSection( ParseData *pd );
+	bool buildSection( ParseData *pd );
+	bool reduceSection( ParseData *pd );
+	bool parallelSections();
+	void prepareSectionsParallel();
 
 	void writeOutput( InputItem *ii );
 	void writeLanguage( std::ostream &out );
@@ -337,6 +467,7 @@ struct InputData
 	void writeDot( std::ostream &out );
 
 	void loadHistogram();
+	void histogramFromCorpus();
 	void defaultHistogram();
 
 	void parseArgs( int argc, const char **argv );
@@ -350,7 +481,13 @@ struct InputData
 	bool process();
 	bool parseReduce();
 
-	char *readInput( const char *inputFileName );
+	bool readInput( const char *inputFileName );
+	void releaseInput();
+	void appendHostData( InputItem *ii, const colm_location *loc,
+			const char *data, long length );
+	void writeHostData( std::ostream &out, InputItem *ii );
+	void endHostSpan( InputItem *ii );
+	void checkInputMap();
 
 	const char **makeIncludePathChecks( const char *curFileName, const char *fileName );
 	std::ifstream *tryOpenInclude( const char **pathChecks, long &found );
@@ -365,6 +502,10 @@ struct InputData
 			int argc, const char **argv );
 
 	int rlhcMain( int argc, const char **argv );
+
+	int watchLoop( IdProcess entry, int argc, const char **argv );
+	int batchLoop( IdProcess entry, int argc, const char **argv );
+	bool batchForked( IdProcess entry, int argc, const char **argv );
 };
 
 
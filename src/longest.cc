@@ -33,40 +33,126 @@
 #include "parsetree.h"
 #include "parsedata.h"
 
-void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
+/* Collect the targets of a state's transitions that a walk which stops at
+ * final states would continue into. Mirrors markReachableFromHereStopFinal. */
+static void stopFinalTargets( Vector<StateAp*> &targets, StateAp *state )
 {
-	graph->markReachableFromHereStopFinal( graph->startState );
-	for ( StateList::Iter ms = graph->stateList; ms.lte(); ms++ ) {
-		if ( ms->stateBits & STB_ISMARKED ) {
-			ms->lmItemSet.insert( 0 );
-			ms->stateBits &= ~ STB_ISMARKED;
+	targets.empty();
+	for ( TransList::Iter trans = state->outList; trans.lte(); trans++ ) {
+		if ( trans->plain() ) {
+			StateAp *toState = trans->tdap()->toState;
+			if ( toState != 0 && !toState->isFinState() )
+				targets.append( toState );
+		}
+		else {
+			for ( CondList::Iter cond = trans->tcap()->condList; cond.lte(); cond++ ) {
+				StateAp *toState = cond->toState;
+				if ( toState != 0 && !toState->isFinState() )
+					targets.append( toState );
+			}
 		}
 	}
+}
+
+/* Summary of the item sets in the states reachable from a state, without
+ * passing through final states. */
+struct LmReach
+{
+	LmReach()
+	:
+		nonFinalNonEmptyItemSet(false),
+		maxItemSetLength(0),
+		onWorklist(false)
+	{}
+
+	bool nonFinalNonEmptyItemSet;
+	int maxItemSetLength;
+	bool onWorklist;
+
+	/* States with a transition into this state that continues the walk. */
+	Vector<StateAp*> preds;
+};
+
+typedef AvlMap<StateAp*, LmReach> LmReachMap;
+
+/* Compute the reach summary of every state in one data-flow pass. The summary
+ * of a state is its own item set merged with the summaries of the non-final
+ * states it goes to, iterated to a fixed point over the predecessors. */
+static void computeLmReach( LmReachMap &reachMap, FsmAp *graph )
+{
+	Vector<StateAp*> targets;
+	Vector<StateAp*> worklist;
 
-	/* Transfer the first item of non-empty lmAction tables to the item sets
-	 * of the states that follow. Exclude states that have no transitions out.
-	 * This must happen on a separate pass so that on each iteration of the
-	 * next pass we have the item set entries from all lmAction tables. */
+	for ( StateList::Iter st = graph->stateList; st.lte(); st++ ) {
+		LmReach &reach = reachMap.insert( st )->value;
+		reach.nonFinalNonEmptyItemSet = st->lmItemSet.length() > 0 && !st->isFinState();
+		reach.maxItemSetLength = st->lmItemSet.length();
+		reach.onWorklist = true;
+		worklist.append( st );
+	}
+
+	for ( StateList::Iter st = graph->stateList; st.lte(); st++ ) {
+		stopFinalTargets( targets, st );
+		for ( Vector<StateAp*>::Iter to = targets; to.lte(); to++ )
+			reachMap.find( *to )->value.preds.append( st );
+	}
+
+	while ( worklist.length() > 0 ) {
+		StateAp *state = worklist[worklist.length()-1];
+		worklist.remove( worklist.length()-1 );
+
+		LmReach &reach = reachMap.find( state )->value;
+		reach.onWorklist = false;
+
+		for ( Vector<StateAp*>::Iter pred = reach.preds; pred.lte(); pred++ ) {
+			LmReach &predReach = reachMap.find( *pred )->value;
+			bool changed = false;
+			if ( reach.nonFinalNonEmptyItemSet && !predReach.nonFinalNonEmptyItemSet ) {
+				predReach.nonFinalNonEmptyItemSet = true;
+				changed = true;
+			}
+			if ( reach.maxItemSetLength > predReach.maxItemSetLength ) {
+				predReach.maxItemSetLength = reach.maxItemSetLength;
+				changed = true;
+			}
+
+			if ( changed && !predReach.onWorklist ) {
+				predReach.onWorklist = true;
+				worklist.append( *pred );
+			}
+		}
+	}
+}
+
+/* Fill the item sets. Each seeded state starts a walk that stops at final
+ * states, and every state the walk touches gets the seed's item. Rather than
+ * walking once per seed, push the items forward with a worklist until no set
+ * grows. */
+void LongestMatch::fillItemSets( FsmAp *graph )
+{
+	Vector<StateAp*> worklist;
+	Vector<StateAp*> targets;
+
+	/* The start state begins with the empty match. */
+	graph->startState->lmItemSet.insert( 0 );
+	graph->startState->stateBits |= STB_ISMARKED;
+	worklist.append( graph->startState );
+
+	/* Seed the first item of non-empty lmAction tables into the states that
+	 * follow. Exclude states that have no transitions out. */
 	for ( StateList::Iter st = graph->stateList; st.lte(); st++ ) {
 		for ( TransList::Iter trans = st->outList; trans.lte(); trans++ ) {
 			if ( trans->plain() ) {
 				TransDataAp *tdap = trans->tdap();
 				if ( tdap->lmActionTable.length() > 0 ) {
-					LmActionTableEl *lmAct = tdap->lmActionTable.data;
 					StateAp *toState = tdap->toState;
 					assert( toState );
 
-					/* Can only optimize this if there are no transitions out.
-					 * Note there can be out transitions going nowhere with
-					 * actions and they too must inhibit this optimization. */
 					if ( toState->outList.length() > 0 ) {
-						/* Fill the item sets. */
-						graph->markReachableFromHereStopFinal( toState );
-						for ( StateList::Iter ms = graph->stateList; ms.lte(); ms++ ) {
-							if ( ms->stateBits & STB_ISMARKED ) {
-								ms->lmItemSet.insert( lmAct->value );
-								ms->stateBits &= ~ STB_ISMARKED;
-							}
+						toState->lmItemSet.insert( tdap->lmActionTable.data->value );
+						if ( ! ( toState->stateBits & STB_ISMARKED ) ) {
+							toState->stateBits |= STB_ISMARKED;
+							worklist.append( toState );
 						}
 					}
 				}
@@ -74,22 +160,14 @@ void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
 			else {
 				for ( CondList::Iter cond = trans->tcap()->condList; cond.lte(); cond++ ) {
 					if ( cond->lmActionTable.length() > 0 ) {
-
-						LmActionTableEl *lmAct = cond->lmActionTable.data;
 						StateAp *toState = cond->toState;
 						assert( toState );
 
-						/* Can only optimize this if there are no transitions out.
-						 * Note there can be out transitions going nowhere with
-						 * actions and they too must inhibit this optimization. */
 						if ( toState->outList.length() > 0 ) {
-							/* Fill the item sets. */
-							graph->markReachableFromHereStopFinal( toState );
-							for ( StateList::Iter ms = graph->stateList; ms.lte(); ms++ ) {
-								if ( ms->stateBits & STB_ISMARKED ) {
-									ms->lmItemSet.insert( lmAct->value );
-									ms->stateBits &= ~ STB_ISMARKED;
-								}
+							toState->lmItemSet.insert( cond->lmActionTable.data->value );
+							if ( ! ( toState->stateBits & STB_ISMARKED ) ) {
+								toState->stateBits |= STB_ISMARKED;
+								worklist.append( toState );
 							}
 						}
 					}
@@ -98,6 +176,34 @@ void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
 		}
 	}
 
+	/* Push item sets forward into non-final states until nothing changes. The
+	 * mark bit says a state is on the worklist. */
+	while ( worklist.length() > 0 ) {
+		StateAp *state = worklist[worklist.length()-1];
+		worklist.remove( worklist.length()-1 );
+		state->stateBits &= ~ STB_ISMARKED;
+
+		stopFinalTargets( targets, state );
+		for ( Vector<StateAp*>::Iter to = targets; to.lte(); to++ ) {
+			StateAp *toState = *to;
+			bool changed = false;
+			for ( LmItemSet::Iter item = state->lmItemSet; item.lte(); item++ ) {
+				if ( toState->lmItemSet.insert( *item ) != 0 )
+					changed = true;
+			}
+
+			if ( changed && ! ( toState->stateBits & STB_ISMARKED ) ) {
+				toState->stateBits |= STB_ISMARKED;
+				worklist.append( toState );
+			}
+		}
+	}
+}
+
+void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
+{
+	fillItemSets( graph );
+
 	/* The lmItem sets are now filled, telling us which longest match rules
 	 * can succeed in which states. First determine if we need to make sure
 	 * act is defaulted to zero. We need to do this if there are any states
@@ -135,6 +241,10 @@ void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
 	Vector<TransAp*> restartData;
 	Vector<CondAp*> restartCond;
 
+	/* What each state can reach, for deciding on the token end. */
+	LmReachMap reachMap;
+	computeLmReach( reachMap, graph );
+
 	/* Set actions that do immediate token recognition, set the longest match part
 	 * id and set the token ending. */
 	for ( StateList::Iter st = graph->stateList; st.lte(); st++ ) {
@@ -168,18 +278,9 @@ void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
 						 * end of the token.  Also Find the highest item set
 						 * length reachable from here (excluding at transtions to
 						 * final states). */
-						bool nonFinalNonEmptyItemSet = false;
-						maxItemSetLength = 0;
-						graph->markReachableFromHereStopFinal( toState );
-						for ( StateList::Iter ms = graph->stateList; ms.lte(); ms++ ) {
-							if ( ms->stateBits & STB_ISMARKED ) {
-								if ( ms->lmItemSet.length() > 0 && !ms->isFinState() )
-									nonFinalNonEmptyItemSet = true;
-								if ( ms->lmItemSet.length() > maxItemSetLength )
-									maxItemSetLength = ms->lmItemSet.length();
-								ms->stateBits &= ~ STB_ISMARKED;
-							}
-						}
+						LmReach &reach = reachMap.find( toState )->value;
+						bool nonFinalNonEmptyItemSet = reach.nonFinalNonEmptyItemSet;
+						maxItemSetLength = reach.maxItemSetLength;
 
 						/* If there are reachable states that are not final and
 						 * have non empty item sets or that have an item set
@@ -228,18 +329,9 @@ void LongestMatch::runLongestMatch( ParseData *pd, FsmAp *graph )
 							 * end of the token.  Also Find the highest item set
 							 * length reachable from here (excluding at transtions to
 							 * final states). */
-							bool nonFinalNonEmptyItemSet = false;
-							maxItemSetLength = 0;
-							graph->markReachableFromHereStopFinal( toState );
-							for ( StateList::Iter ms = graph->stateList; ms.lte(); ms++ ) {
-								if ( ms->stateBits & STB_ISMARKED ) {
-									if ( ms->lmItemSet.length() > 0 && !ms->isFinState() )
-										nonFinalNonEmptyItemSet = true;
-									if ( ms->lmItemSet.length() > maxItemSetLength )
-										maxItemSetLength = ms->lmItemSet.length();
-									ms->stateBits &= ~ STB_ISMARKED;
-								}
-							}
+							LmReach &reach = reachMap.find( toState )->value;
+							bool nonFinalNonEmptyItemSet = reach.nonFinalNonEmptyItemSet;
+							maxItemSetLength = reach.maxItemSetLength;
 
 							/* If there are reachable states that are not final and
 							 * have non empty item sets or that have an item set
@@ -362,14 +454,11 @@ FsmRes LongestMatch::buildBaseNfa( ParseData *pd )
 		}
 	}
 
-	/* Union machines one and up with machine zero. The grammar dictates that
-	 * there will always be at least one part. */
-	FsmRes fsm( FsmRes::Fsm(), parts[0] );
-	for ( int i = 1; i < longestMatchList->length(); i++ ) {
-		fsm = FsmAp::unionOp( fsm, parts[i] );
-		if ( !fsm.success() )
-			return fsm;
-	}
+	/* Union the machines together. The grammar dictates that there will
+	 * always be at least one part. */
+	FsmRes fsm = unionParts( parts, longestMatchList->length() );
+	if ( !fsm.success() )
+		return fsm;
 
 	/* Create a new, isolated start state into which we can embed tokstart
 	 * functions. */
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "memusage.h"
+
+#include <libfsm/fsmgraph.h>
+
+/* Tables are sorted vectors. Count what their elements occupy. */
+template <class Table> static long tableBytes( const Table &table )
+{
+	return table.length() * sizeof(*table.data);
+}
+
+static long condBytes( CondAp *cond )
+{
+	return tableBytes( cond->actionTable ) +
+			tableBytes( cond->priorTable ) +
+			tableBytes( cond->lmActionTable );
+}
+
+void FsmMemUsage::measure( FsmAp *fsm )
+{
+	states = transitions = actionTables = condSpaces = 0;
+
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		states += sizeof(StateAp);
+
+		actionTables +=
+				tableBytes( st->toStateActionTable ) +
+				tableBytes( st->fromStateActionTable ) +
+				tableBytes( st->outActionTable ) +
+				tableBytes( st->outPriorTable ) +
+				tableBytes( st->errActionTable ) +
+				tableBytes( st->eofActionTable );
+
+		for ( TransList::Iter trans = st->outList; trans.lte(); trans++ ) {
+			if ( trans->plain() ) {
+				TransDataAp *tdap = trans->tdap();
+				transitions += sizeof(TransDataAp);
+				actionTables +=
+						tableBytes( tdap->actionTable ) +
+						tableBytes( tdap->priorTable ) +
+						tableBytes( tdap->lmActionTable );
+			}
+			else {
+				transitions += sizeof(TransCondAp);
+				for ( CondList::Iter cond = trans->tcap()->condList; cond.lte(); cond++ ) {
+					transitions += sizeof(CondAp);
+					actionTables += condBytes( cond );
+				}
+			}
+		}
+	}
+
+	CondSpaceMap &condSpaceMap = fsm->ctx->condData->condSpaceMap;
+	for ( CondSpaceMap::Iter cs = condSpaceMap; cs.lte(); cs++ )
+		condSpaces += sizeof(CondSpace) + tableBytes( cs->condSet );
+}
+
+void FsmMemUsage::peak( const FsmMemUsage &other )
+{
+	if ( other.total() > total() ) {
+		states = other.states;
+		transitions = other.transitions;
+		actionTables = other.actionTables;
+		condSpaces = other.condSpaces;
+	}
+}
+
+void FsmMemUsage::write( std::ostream &out ) const
+{
+	out << total() << " bytes (states " << states <<
+			", transitions " << transitions <<
+			", action tables " << actionTables <<
+			", cond spaces " << condSpaces << ")";
+}
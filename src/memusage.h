@@ -0,0 +1,69 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MEMUSAGE_H
+#define _MEMUSAGE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct FsmAp;
+struct FsmCtx;
+
+/*
+ * Approximate bytes held by a graph, split by what holds them. Action tables
+ * include the priority and longest-match tables hanging off states and
+ * transitions. Allocator overhead is not counted.
+ */
+struct FsmMemUsage
+{
+	FsmMemUsage()
+		: states(0), transitions(0), actionTables(0), condSpaces(0) {}
+
+	long states;
+	long transitions;
+	long actionTables;
+	long condSpaces;
+
+	long total() const
+		{ return states + transitions + actionTables + condSpaces; }
+
+	/* Measure a graph and the condition spaces of its context. */
+	void measure( FsmAp *fsm );
+
+	/* Keep whichever usage is larger in total. */
+	void peak( const FsmMemUsage &other );
+
+	void write( std::ostream &out ) const;
+};
+
+/* Largest usage seen in one phase of the compile. */
+struct MemPeak
+{
+	std::string phase;
+	FsmMemUsage usage;
+};
+
+typedef std::vector<MemPeak> MemPeakVect;
+
+#endif
@@ -23,11 +23,18 @@
 #include "stdlib.h"
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
 #include <libfsm/common.h>
 #include <libfsm/ragel.h>
 
 #include "nragel.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
  * C
  */
@@ -107,28 +114,114 @@ HostType *findAlphTypeInternal( const HostLang *hostLang, const char *s1 )
 	return 0;
 }
 
-std::streamsize output_filter::countAndWrite( const char *s, std::streamsize n )
+/* Counts the newlines, open and close braces in a block of output. The
+ * filter only needs the totals, so whole vectors are compared at a time. */
+static void countOutput( const char *s, std::streamsize n,
+		long &lines, long &opens, long &closes )
 {
-	for ( int i = 0; i < n; i++ ) {
+	std::streamsize i = 0;
+
+#if defined(__GNUC__) && defined(__AVX2__)
+	const __m256i nl = _mm256_set1_epi8( '\n' );
+	const __m256i ob = _mm256_set1_epi8( '{' );
+	const __m256i cb = _mm256_set1_epi8( '}' );
+	for ( ; i + 32 <= n; i += 32 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i*)(s + i) );
+		lines += __builtin_popcount( (unsigned)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8( v, nl ) ) );
+		opens += __builtin_popcount( (unsigned)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8( v, ob ) ) );
+		closes += __builtin_popcount( (unsigned)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8( v, cb ) ) );
+	}
+#elif defined(__GNUC__) && defined(__SSE2__)
+	const __m128i nl = _mm_set1_epi8( '\n' );
+	const __m128i ob = _mm_set1_epi8( '{' );
+	const __m128i cb = _mm_set1_epi8( '}' );
+	for ( ; i + 16 <= n; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i*)(s + i) );
+		lines += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8( v, nl ) ) );
+		opens += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8( v, ob ) ) );
+		closes += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8( v, cb ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ ) {
 		switch ( s[i] ) {
 		case '\n':
-			line += 1;
+			lines += 1;
 			break;
 		case '{':
-			/* If we detec an open block then eliminate the single-indent
-			 * addition, which is to account for single statements. */
-			singleIndent = false;
-			level += 1;
+			opens += 1;
 			break;
 		case '}':
-			level -= 1;
+			closes += 1;
 			break;
 		}
 	}
+}
+
+std::streamsize output_filter::countAndWrite( const char *s, std::streamsize n )
+{
+	long lines = 0, opens = 0, closes = 0;
+	countOutput( s, n, lines, opens, closes );
+
+	/* If we detect an open block then eliminate the single-indent addition,
+	 * which is to account for single statements. */
+	if ( opens > 0 )
+		singleIndent = false;
+
+	line += lines;
+	level += opens - closes;
 
 	return std::filebuf::xsputn( s, n );
 }
 
+/* Indentation contains nothing the filter counts, so it goes straight to the
+ * file buffer, as many tabs at a time as possible. */
+void output_filter::writeIndent( int tabs )
+{
+	static const char indentTabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	const int max = sizeof(indentTabs) - 1;
+
+	while ( tabs > 0 ) {
+		int len = tabs < max ? tabs : max;
+		std::filebuf::xsputn( indentTabs, len );
+		tabs -= len;
+	}
+}
+
+/* Table data lines start with a number. */
+static bool tableLine( const char *s, std::streamsize n )
+{
+	return n > 0 && ( isdigit( (unsigned char)s[0] ) ||
+			( n > 1 && s[0] == '-' && isdigit( (unsigned char)s[1] ) ) );
+}
+
+/* Length of the run of complete table data lines at the start of s. */
+static std::streamsize tableRun( const char *s, std::streamsize n )
+{
+	std::streamsize run = 0;
+	while ( true ) {
+		const char *p = s + run;
+		std::streamsize left = n - run;
+		while ( left > 0 && ( *p == ' ' || *p == '\t' ) ) {
+			p += 1;
+			left -= 1;
+		}
+
+		if ( !tableLine( p, left ) )
+			break;
+
+		const char *nl = (const char*)memchr( p, '\n', left );
+		if ( nl == 0 )
+			break;
+
+		run = nl - s + 1;
+	}
+	return run;
+}
+
 bool openSingleIndent( const char *s, int n )
 {
 	if ( n >= 3 && memcmp( s, "if ", 3 ) == 0 )
@@ -154,16 +247,34 @@ int output_filter::sync( )
 std::streamsize output_filter::xsputn( const char *s, std::streamsize n )
 {
 	std::streamsize ret = n;
-	int l;
 
 restart:
 	if ( indent ) {
+		const char *ls = s;
+		std::streamsize ln = n;
+
 		/* Consume mode Looking for the first non-whitespace. */
 		while ( n > 0 && ( *s == ' ' || *s == '\t' ) ) {
 			s += 1;
 			n -= 1;
 		}
 
+		if ( n > 0 && !reindentTables && tableLine( s, n ) ) {
+			/* Table data. Write the lines as generated, all in one go. */
+			singleIndent = false;
+			std::streamsize wl = tableRun( ls, ln );
+			if ( wl == 0 ) {
+				countAndWrite( ls, ln );
+				indent = false;
+				return ret;
+			}
+
+			countAndWrite( ls, wl );
+			s = ls + wl;
+			n = ln - wl;
+			goto restart;
+		}
+
 		if ( n > 0 ) {
 			int tabs = level + ( singleIndent ? 1 : 0 );
 
@@ -184,8 +295,7 @@ restart:
 			if ( *s != '#' ) {
 				/* Found some data, print the indentation and turn off indentation
 				 * mode. */
-				for ( l = 0; l < tabs; l++ )
-					countAndWrite( "\t", 1 );
+				writeIndent( tabs );
 			}
 
 
@@ -55,19 +55,24 @@ public:
 		line(1),
 		level(0),
 		indent(false),
-		singleIndent(false)
+		singleIndent(false),
+		reindentTables(true)
 	{}
 
 	virtual int sync();
 	virtual std::streamsize xsputn( const char* s, std::streamsize n );
 
 	std::streamsize countAndWrite( const char* s, std::streamsize n );
+	void writeIndent( int tabs );
 
 	const char *fileName;
 	int line;
 	int level;
 	bool indent;
 	bool singleIndent;
+
+	/* When false, lines of table data are written as generated. */
+	bool reindentTables;
 };
 
 class cfilebuf : public std::streambuf
@@ -25,6 +25,8 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <queue>
+#include <vector>
 
 #include <colm/tree.h>
 #include <libfsm/ragel.h>
@@ -34,6 +36,7 @@
 #include "version.h"
 #include "inputdata.h"
 #include "nragel.h"
+#include "workers.h"
 
 using namespace std;
 
@@ -111,7 +114,7 @@ Key makeFsmKeyHex( char *str, const InputLoc &loc, ParseData *pd )
 	unsigned long ul = strtoul( str, 0, 16 );
 
 	if ( errno == ERANGE || ( unusedBits && ul >> (size * 8) ) ) {
-		pd->id->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
+		pd->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
 		ul = 1 << (size * 8);
 	}
 
@@ -134,12 +137,12 @@ Key makeFsmKeyDec( char *str, const InputLoc &loc, ParseData *pd )
 
 		/* Check for underflow. */
 		if ( ( errno == ERANGE && ll < 0 ) || ll < minVal ) {
-			pd->id->error(loc) << "literal " << str << " underflows the alphabet type" << endl;
+			pd->error(loc) << "literal " << str << " underflows the alphabet type" << endl;
 			ll = minVal;
 		}
 		/* Check for overflow. */
 		else if ( ( errno == ERANGE && ll > 0 ) || ll > maxVal ) {
-			pd->id->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
+			pd->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
 			ll = maxVal;
 		}
 
@@ -156,12 +159,12 @@ Key makeFsmKeyDec( char *str, const InputLoc &loc, ParseData *pd )
 
 		/* Check for underflow. */
 		if ( ( errno == ERANGE && ull < 0 ) || ull < minVal ) {
-			pd->id->error(loc) << "literal " << str << " underflows the alphabet type" << endl;
+			pd->error(loc) << "literal " << str << " underflows the alphabet type" << endl;
 			ull = minVal;
 		}
 		/* Check for overflow. */
 		else if ( ( errno == ERANGE && ull > 0 ) || ull > maxVal ) {
-			pd->id->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
+			pd->error(loc) << "literal " << str << " overflows the alphabet type" << endl;
 			ull = maxVal;
 		}
 
@@ -391,6 +394,66 @@ FsmAp *makeBuiltin( BuiltinMachine builtin, ParseData *pd )
 	return retFsm;
 }
 
+/* A machine waiting to be unioned, with its state count taken when it was
+ * queued. Order breaks ties in favour of the earlier machine. */
+struct UnionPart
+{
+	UnionPart( FsmAp *fsm, int order )
+		: fsm(fsm), states(fsm->stateList.length()), order(order) {}
+
+	FsmAp *fsm;
+	int states;
+	int order;
+};
+
+/* Puts the smallest part at the top of a std::priority_queue. */
+struct CmpUnionPart
+{
+	bool operator()( const UnionPart &p1, const UnionPart &p2 ) const
+	{
+		if ( p1.states != p2.states )
+			return p1.states > p2.states;
+		return p1.order > p2.order;
+	}
+};
+
+/* Union a list of machines. Rather than folding each one into a growing
+ * result, always union the two smallest machines (by state count), taken
+ * from a min-heap. Each state then takes part in a logarithmic number of
+ * unions. There must be at least one part. On failure the parts not yet
+ * consumed are deleted. */
+FsmRes unionParts( FsmAp **parts, int numParts )
+{
+	std::priority_queue<UnionPart, std::vector<UnionPart>, CmpUnionPart> queue;
+	for ( int i = 0; i < numParts; i++ )
+		queue.push( UnionPart( parts[i], i ) );
+
+	while ( queue.size() > 1 ) {
+		UnionPart first = queue.top();
+		queue.pop();
+		UnionPart second = queue.top();
+		queue.pop();
+
+		/* The union takes the place of the earlier of the two. */
+		int order = first.order < second.order ? first.order : second.order;
+		FsmAp *low = first.order < second.order ? first.fsm : second.fsm;
+		FsmAp *high = first.order < second.order ? second.fsm : first.fsm;
+
+		FsmRes res = FsmAp::unionOp( low, high );
+		if ( !res.success() ) {
+			while ( !queue.empty() ) {
+				delete queue.top().fsm;
+				queue.pop();
+			}
+			return res;
+		}
+
+		queue.push( UnionPart( res.fsm, order ) );
+	}
+
+	return FsmRes( FsmRes::Fsm(), queue.top().fsm );
+}
+
 /* Check if this name inst or any name inst below is referenced. */
 bool NameInst::anyRefsRec()
 {
@@ -441,7 +504,12 @@ ParseData::ParseData( InputData *id, string sectionName,
 	nextEpsilonResolvedLink(0),
 	nextLongestMatchId(1),
 	nextRepId(1),
-	cgd(0)
+	cgd(0),
+	prepared(false),
+	prepareSuccess(false),
+	walkWarnings(0),
+	sectionErrors(0),
+	memLimitHit(false)
 {
 	fsmCtx = new FsmCtx( id );
 
@@ -456,6 +524,7 @@ ParseData::ParseData( InputData *id, string sectionName,
 /* Clean up the data collected during a parse. */
 ParseData::~ParseData()
 {
+	clearDefGraphs();
 	graphDict.empty();
 	fsmCtx->actionList.empty();
 
@@ -592,6 +661,159 @@ NameInst *ParseData::addNameInst( const InputLoc &loc, std::string data, bool is
 	return newNameInst;
 }
 
+void ParseData::reportTime( const char *phase, double start,
+		const std::string &name, FsmAp *fsm )
+{
+	if ( id->timeReport != 0 ) {
+		double seconds = timeNow() - start;
+		if ( fsm != 0 ) {
+			id->timeReport->add( sectionName, phase, name, seconds,
+					fsm->stateList.length(), countTransitions( fsm ) );
+		}
+		else {
+			id->timeReport->add( sectionName, phase, name, seconds );
+		}
+	}
+}
+
+std::ostream &ParseData::walkWarning( const InputLoc &loc )
+{
+	walkWarnings += 1;
+	return id->warning( loc );
+}
+
+/* The global count is shared by the sections built in parallel. */
+std::ostream &ParseData::error( const InputLoc &loc )
+{
+	sectionErrors += 1;
+	id->errorLock.lock();
+	std::ostream &out = id->error( loc );
+	id->errorLock.unlock();
+	return out;
+}
+
+std::ostream &ParseData::error()
+{
+	sectionErrors += 1;
+	id->errorLock.lock();
+	std::ostream &out = id->error();
+	id->errorLock.unlock();
+	return out;
+}
+
+/* Record the memory held by a graph against a phase of the compile. Returns
+ * false if the graph is over the memory limit. */
+bool ParseData::accountMemory( const char *phase, FsmAp *fsm )
+{
+	if ( id->memLimit == 0 && !id->printStatistics )
+		return true;
+
+	FsmMemUsage usage;
+	usage.measure( fsm );
+
+	size_t p = 0;
+	while ( p < memPeaks.size() && memPeaks[p].phase != phase )
+		p += 1;
+
+	if ( p < memPeaks.size() )
+		memPeaks[p].usage.peak( usage );
+	else {
+		MemPeak memPeak;
+		memPeak.phase = phase;
+		memPeak.usage = usage;
+		memPeaks.push_back( memPeak );
+	}
+
+	if ( id->memLimit > 0 && usage.total() > id->memLimit ) {
+		memLimitHit = true;
+		memLimitUsage = usage;
+		return false;
+	}
+
+	return true;
+}
+
+/* Applied to the result of each graph operation in the walk, so a walk stops
+ * at the first intermediate graph that goes over the memory limit. The
+ * failure travels up the walk as too many states. */
+FsmRes ParseData::checkMemLimit( FsmRes res )
+{
+	/* Measuring is a pass over the graph. Without a limit, the statistics
+	 * take the walk peak once per instance instead. */
+	if ( id->memLimit == 0 )
+		return res;
+
+	if ( res.success() && !accountMemory( "walk", res.fsm ) ) {
+		delete res.fsm;
+		return FsmRes( FsmRes::TooManyStates() );
+	}
+	return res;
+}
+
+/* The state limit applied while walking. A memory limit also bounds the
+ * number of states, which lets libfsm stop inside a single operation. */
+long ParseData::walkStateLimit()
+{
+	long limit = id->stateLimit;
+	if ( id->memLimit > 0 ) {
+		long memStates = id->memLimit / sizeof(StateAp);
+		if ( memStates < 1 )
+			memStates = 1;
+		if ( limit == 0 || memStates < limit )
+			limit = memStates;
+	}
+	return limit;
+}
+
+/* Called by each definition a failed walk unwinds through. The first one is
+ * where the graph blew up. Libfsm may also stop on the state limit that is
+ * derived from the memory limit, before there is a graph to measure. */
+void ParseData::memLimitFailure( const FsmRes &res, const std::string &defName )
+{
+	if ( id->memLimit == 0 || res.type != FsmRes::TypeTooManyStates )
+		return;
+
+	/* Stopped by the user's own state limit. */
+	if ( !memLimitHit && id->stateLimit > 0 && id->stateLimit == walkStateLimit() )
+		return;
+
+	if ( memLimitDef.empty() ) {
+		memLimitHit = true;
+		memLimitDef = defName;
+		memLimitLoc = curNameInst->loc;
+	}
+}
+
+void ParseData::reportMemLimit( const std::string &instName )
+{
+	std::ostream &out = memLimitDef.empty() ?
+			error() << "machine " << sectionName :
+			error(memLimitLoc) << "definition " << memLimitDef;
+
+	if ( !instName.empty() && instName != memLimitDef )
+		out << " (in instance " << instName << ")";
+
+	out << " exceeds the memory limit of " << id->memLimit << " bytes";
+
+	if ( memLimitUsage.total() > 0 ) {
+		out << ", graph holds ";
+		memLimitUsage.write( out );
+	}
+	else {
+		out << ", stopped at " << fsmCtx->stateLimit << " states";
+	}
+	out << endl;
+}
+
+void ParseData::writeMemPeaks( std::ostream &out )
+{
+	for ( size_t p = 0; p < memPeaks.size(); p++ ) {
+		out << "mem-peak\t" << memPeaks[p].phase << "\t";
+		memPeaks[p].usage.write( out );
+		out << endl;
+	}
+}
+
 void ParseData::initNameWalk()
 {
 	curNameInst = rootName;
@@ -782,7 +1004,7 @@ void ParseData::errorStateLabels( const NameSet &resolved )
 	MergeSort<NameInst*, CmpNameInstLoc> mergeSort;
 	mergeSort.sort( resolved.data, resolved.length() );
 	for ( NameSet::Iter res = resolved; res.lte(); res++ )
-		id->error((*res)->loc) << "  -> " << **res << endl;
+		error((*res)->loc) << "  -> " << **res << endl;
 }
 
 
@@ -805,7 +1027,7 @@ NameInst *ParseData::resolveStateRef( NameRef *nameRef, InputLoc &loc, Action *a
 				nameInst = resolved[0];
 				if ( resolved.length() > 1 ) {
 					/* Complain about the multiple references. */
-					id->error(loc) << "state reference " << *nameRef << 
+					error(loc) << "state reference " << *nameRef << 
 							" resolves to multiple entry points" << endl;
 					errorStateLabels( resolved );
 				}
@@ -824,7 +1046,7 @@ NameInst *ParseData::resolveStateRef( NameRef *nameRef, InputLoc &loc, Action *a
 			nameInst = resolved[0];
 			if ( resolved.length() > 1 ) {
 				/* Complain about the multiple references. */
-				id->error(loc) << "state reference " << *nameRef << 
+				error(loc) << "state reference " << *nameRef << 
 						" resolves to multiple entry points" << endl;
 				errorStateLabels( resolved );
 			}
@@ -833,7 +1055,7 @@ NameInst *ParseData::resolveStateRef( NameRef *nameRef, InputLoc &loc, Action *a
 
 	if ( nameInst == 0 ) {
 		/* If not found then complain. */
-		id->error(loc) << "could not resolve state reference " << *nameRef << endl;
+		error(loc) << "could not resolve state reference " << *nameRef << endl;
 	}
 	return nameInst;
 }
@@ -854,7 +1076,7 @@ void ParseData::resolveNameRefs( InlineList *inlineList, Action *action )
 					NameInst *search = target->parent;
 					while ( search != 0 ) {
 						if ( search->isLongestMatch ) {
-							id->error(item->loc) << "cannot enter inside a longest "
+							error(item->loc) << "cannot enter inside a longest "
 									"match construction as an entry point" << endl;
 							break;
 						}
@@ -1163,26 +1385,104 @@ void ParseData::longestMatchInitTweaks( FsmAp *graph )
 }
 
 /* Always returns the breadth check result. Will not consume the fsm. */
-BreadthResult *ParseData::checkBreadth( FsmAp *fsm )
+/* Breadth computations for a group of entries. Each group has a copy of the
+ * graph of its own, so the groups can run in parallel. */
+struct BreadthGroup
+:
+	public WorkItem
 {
-	double start = 0;
-	int minDepth = 0;
-	FsmAp::breadthFromEntry( start, minDepth, id->histogram, fsm, fsm->startState );
+	BreadthGroup( double *histogram, FsmAp *fsm )
+		: histogram(histogram), fsm(fsm) {}
 
-	BreadthResult *breadth = new BreadthResult( start );
-	
+	~BreadthGroup()
+		{ delete fsm; }
+
+	void work()
+	{
+		for ( long i = 0; i < entries.length(); i++ ) {
+			int minDepth = 0;
+			FsmAp::breadthFromEntry( *costs[i], minDepth, histogram, fsm, entries[i] );
+		}
+	}
+
+	double *histogram;
+	FsmAp *fsm;
+	Vector<StateAp*> entries;
+	Vector<double*> costs;
+};
+
+BreadthResult *ParseData::checkBreadth( FsmAp *fsm )
+{
+	/* The start state, then the entry points of each cut, looked up directly
+	 * in the entry map. */
+	Vector<StateAp*> entries;
+	Vector<Cut*> entryCuts;
+	entries.append( fsm->startState );
+	entryCuts.append( 0 );
 	for ( Vector<ParseData::Cut>::Iter c = cuts; c.lte(); c++ ) {
-		for ( EntryMap::Iter mel = fsm->entryPoints; mel.lte(); mel++ ) {
-			if ( mel->key == c->entryId ) {
-				double cost = 0;
-				int minDepth = 0;
-				FsmAp::breadthFromEntry( cost, minDepth, id->histogram, fsm, mel->value );
+		EntryMapEl *low, *high;
+		if ( fsm->entryPoints.findMulti( c->entryId, low, high ) ) {
+			for ( EntryMapEl *mel = low; mel <= high; mel++ ) {
+				entries.append( mel->value );
+				entryCuts.append( c );
+			}
+		}
+	}
+
+	double *costs = new double[entries.length()];
+	for ( long e = 0; e < entries.length(); e++ )
+		costs[e] = 0;
+
+	int numGroups = id->numJobs < entries.length() ? id->numJobs : entries.length();
+	if ( numGroups <= 1 ) {
+		for ( long e = 0; e < entries.length(); e++ ) {
+			int minDepth = 0;
+			FsmAp::breadthFromEntry( costs[e], minDepth, id->histogram, fsm, entries[e] );
+		}
+	}
+	else {
+		/* States of a copy are in the same order as the original's, so
+		 * entries carry over by position. */
+		BstMap<StateAp*, long> entryPos;
+		for ( long e = 0; e < entries.length(); e++ )
+			entryPos.insert( entries[e], 0 );
+
+		long pos = 0;
+		for ( StateList::Iter st = fsm->stateList; st.lte(); st++, pos++ ) {
+			BstMapEl<StateAp*, long> *ep = entryPos.find( st );
+			if ( ep != 0 )
+				ep->value = pos;
+		}
+
+		StateAp **states = new StateAp*[fsm->stateList.length()];
 
-				breadth->costs.append( BreadthCost( c->name, cost ) );
+		WorkItemVect items;
+		for ( int g = 0; g < numGroups; g++ ) {
+			FsmAp *copy = new FsmAp( *fsm );
+			long s = 0;
+			for ( StateList::Iter st = copy->stateList; st.lte(); st++ )
+				states[s++] = st;
+
+			BreadthGroup *group = new BreadthGroup( id->histogram, copy );
+			for ( long e = g; e < entries.length(); e += numGroups ) {
+				group->entries.append( states[entryPos.find( entries[e] )->value] );
+				group->costs.append( &costs[e] );
 			}
+			items.append( group );
 		}
+
+		runWorkItems( items, numGroups );
+
+		for ( WorkItemVect::Iter wi = items; wi.lte(); wi++ )
+			delete *wi;
+		delete[] states;
 	}
 
+	BreadthResult *breadth = new BreadthResult( costs[0] );
+	for ( long e = 1; e < entries.length(); e++ )
+		breadth->costs.append( BreadthCost( entryCuts[e]->name, costs[e] ) );
+
+	delete[] costs;
 	return breadth;
 }
 
@@ -1231,19 +1531,87 @@ void ParseData::reportAnalysisResult( FsmRes &res )
 }
 
 
+/* Does any transition in the graph test conditions? Without them the
+ * condition cost search has nothing to find. */
+static bool hasCondTrans( FsmAp *fsm )
+{
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		if ( st->outCondSpace != 0 )
+			return true;
+
+		for ( TransList::Iter trans = st->outList; trans.lte(); trans++ ) {
+			if ( !trans->plain() )
+				return true;
+		}
+	}
+	return false;
+}
+
+/* Most keys a state can leave on and still be scanned with a vector set
+ * lookup. */
+#define SKIP_LOOP_MAX_EXITS 16
+
+/* Can the state be run as a scan to the next exit key? It must loop on itself
+ * over all but a few keys of a byte alphabet, with nothing that has to run on
+ * each step: no actions, conditions or priorities on the loop, and no to-state
+ * or from-state actions. */
+static bool skipLoopState( StateAp *st, KeyOps *keyOps )
+{
+	if ( st->nfaOut != 0 || st->toStateActionTable.length() > 0 ||
+			st->fromStateActionTable.length() > 0 )
+		return false;
+
+	long loopKeys = 0;
+	for ( TransList::Iter trans = st->outList; trans.lte(); trans++ ) {
+		if ( !trans->plain() || trans->tdap()->toState != st )
+			continue;
+
+		TransDataAp *tdap = trans->tdap();
+		if ( tdap->actionTable.length() > 0 || tdap->priorTable.length() > 0 ||
+				tdap->lmActionTable.length() > 0 )
+			return false;
+
+		loopKeys += trans->highKey.getVal() - trans->lowKey.getVal() + 1;
+	}
+
+	long alphSize = keyOps->maxKey.getVal() - keyOps->minKey.getVal() + 1;
+	return loopKeys > 0 && alphSize <= 256 &&
+			alphSize - loopKeys <= SKIP_LOOP_MAX_EXITS;
+}
+
+/* Number of states that a code generator could turn into a skip loop. */
+static long skipLoopStates( FsmAp *fsm, KeyOps *keyOps )
+{
+	long count = 0;
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		if ( skipLoopState( st, keyOps ) )
+			count += 1;
+	}
+	return count;
+}
+
 /* Make the graph from a graph dict node. Does minimization and state sorting. */
 FsmRes ParseData::makeInstance( GraphDictEl *gdNode )
 {
 	if ( id->printStatistics )
 		id->stats() << "compiling\t" << sectionName << endl;
 	
-	if ( id->stateLimit > 0 )
-		fsmCtx->stateLimit = id->stateLimit;
+	long stateLimit = walkStateLimit();
+	if ( stateLimit > 0 )
+		fsmCtx->stateLimit = stateLimit;
 
 	/* Build the graph from a walk of the parse tree. */
+	double start = timeNow();
 	FsmRes graph = gdNode->value->walk( this );
+	reportTime( "walk", start, gdNode->key, graph.success() ? graph.fsm : 0 );
 
-	if ( id->stateLimit > 0 )
+	if ( !graph.success() && memLimitHit )
+		reportMemLimit( gdNode->key );
+
+	if ( graph.success() && id->memLimit == 0 )
+		accountMemory( "walk", graph.fsm );
+
+	if ( stateLimit > 0 )
 		fsmCtx->stateLimit = FsmCtx::STATE_UNLIMITED;
 
 	/* Perform the breadth computation. This does not affect the FSM result. We
@@ -1254,19 +1622,33 @@ FsmRes ParseData::makeInstance( GraphDictEl *gdNode )
 		reportBreadthResults( breadth );
 	}
 
-	if ( id->condsCheckDepth >= 0 ) {
+	if ( graph.success() && id->condsCheckDepth >= 0 ) {
 		/* Use this to expand generalized repetition to past the nfa union
 		 * choice point. */
 		fsmCtx->condsCheckDepth = id->condsCheckDepth;
-		graph = FsmAp::condCostSearch( graph.fsm );
+		if ( hasCondTrans( graph.fsm ) ) {
+			start = timeNow();
+			graph = FsmAp::condCostSearch( graph.fsm );
+			reportTime( "conds", start, gdNode->key, graph.success() ? graph.fsm : 0 );
+		}
 	}
 
 	if ( !graph.success() ) {
-		reportAnalysisResult( graph );
+		/* A memory limit failure has been reported already. */
+		if ( !memLimitHit )
+			reportAnalysisResult( graph );
 		return graph;
 	}
 
+	start = timeNow();
 	fsmCtx->finalizeInstance( graph.fsm );
+	reportTime( "finalize", start, gdNode->key, graph.fsm );
+	accountMemory( "finalize", graph.fsm );
+
+	if ( id->printStatistics ) {
+		id->stats() << "skip-loop states\t" <<
+				skipLoopStates( graph.fsm, fsmCtx->keyOps ) << endl;
+	}
 
 	return graph;
 }
@@ -1316,9 +1698,12 @@ FsmRes ParseData::makeSpecific( GraphDictEl *gdNode )
 FsmRes ParseData::makeAll()
 {
 	/* Build the name tree and supporting data structures. */
+	double start = timeNow();
 	makeNameTree( 0 );
+	reportTime( "name-tree", start );
 
 	/* Resove name references in the tree. */
+	start = timeNow();
 	initNameWalk();
 	for ( GraphList::Iter glel = instanceList; glel.lte(); glel++ )
 		glel->value->resolveNameRefs( this );
@@ -1330,11 +1715,17 @@ FsmRes ParseData::makeAll()
 	for ( NameVect::Iter inst = rootName->childVect; inst.lte(); inst++ )
 		(*inst)->numRefs += 1;
 
+	reportTime( "resolve", start );
+
 	FsmAp *mainGraph = 0;
 	FsmAp **graphs = new FsmAp*[instanceList.length()];
 	int numOthers = 0;
 
-	/* Make all the instantiations, we know that main exists in this list. */
+	/* Make all the instantiations, we know that main exists in this list.
+	 * They are built one after another, not concurrently. The instances
+	 * share the section's FsmCtx, and libfsm assigns its action and priority
+	 * ordinals, condition spaces and action list as each graph is built.
+	 * Parallel builds happen a level up, one FsmCtx per section. */
 	initNameWalk();
 	for ( GraphList::Iter glel = instanceList; glel.lte();  glel++ ) {
 		FsmRes res = makeInstance( glel );
@@ -1357,10 +1748,19 @@ FsmRes ParseData::makeAll()
 
 	if ( numOthers > 0 ) {
 		/* Add all the other graphs into main. */
+		start = timeNow();
 		mainGraph->globOp( graphs, numOthers );
+		reportTime( "merge", start, std::string(), mainGraph );
 	}
 
 	delete[] graphs;
+
+	if ( !accountMemory( "merge", mainGraph ) ) {
+		reportMemLimit( std::string() );
+		delete mainGraph;
+		return FsmRes( FsmRes::TooManyStates() );
+	}
+
 	return FsmRes( FsmRes::Fsm(), mainGraph );
 }
 
@@ -1381,6 +1781,7 @@ void ParseData::makeExportsNameTree()
 
 void ParseData::makeExports()
 {
+	double start = timeNow();
 	makeExportsNameTree();
 
 	/* Resove name references in the tree. */
@@ -1400,7 +1801,7 @@ void ParseData::makeExports()
 
 			/* Build the graph from a walk of the parse tree. */
 			if ( !graph.fsm->checkSingleCharMachine() ) {
-				id->error(gdel->loc) << "bad export machine, must define "
+				error(gdel->loc) << "bad export machine, must define "
 						"a single character" << endl;
 			}
 			else {
@@ -1410,6 +1811,11 @@ void ParseData::makeExports()
 			}
 		}
 	}
+
+	/* No more walks in this section. */
+	clearDefGraphs();
+
+	reportTime( "exports", start );
 }
 
 FsmRes ParseData::prepareMachineGen( GraphDictEl *graphDictEl, const HostLang *hostLang )
@@ -1433,15 +1839,24 @@ FsmRes ParseData::prepareMachineGen( GraphDictEl *graphDictEl, const HostLang *h
 	}
 	
 	/* If any errors have occured in the input file then don't write anything. */
-	if ( id->errorCount > 0 )
+	if ( sectionErrors > 0 )
 		return FsmRes( FsmRes::InternalError() );
 
+	double start = timeNow();
 	fsmCtx->analyzeGraph( sectionGraph );
+	reportTime( "analyze", start, std::string(), sectionGraph );
+	accountMemory( "analyze", sectionGraph );
 
 	/* Depends on the graph analysis. */
 	longestMatchInitTweaks( sectionGraph );
 
+	start = timeNow();
 	fsmCtx->prepareReduction( sectionGraph );
+	reportTime( "prepare-reduction", start, std::string(), sectionGraph );
+	accountMemory( "prepare-reduction", sectionGraph );
+
+	if ( id->printStatistics )
+		writeMemPeaks( id->stats() );
 
 	return FsmRes( FsmRes::Fsm(), sectionGraph );
 }
@@ -1449,8 +1864,10 @@ FsmRes ParseData::prepareMachineGen( GraphDictEl *graphDictEl, const HostLang *h
 void ParseData::generateReduced( const char *inputFileName, CodeStyle codeStyle,
 		std::ostream &out, const HostLang *hostLang )
 {
+	double start = timeNow();
 	Reducer *red = new Reducer( this->id, fsmCtx, sectionGraph, sectionName, machineId );
 	red->make();
+	reportTime( "reduce", start );
 
 	CodeGenArgs args( this->id, red, alphType, machineId, inputFileName, sectionName, out, codeStyle, hostLang->genLineDirective, hostLang->backend );
 
@@ -1462,7 +1879,9 @@ void ParseData::generateReduced( const char *inputFileName, CodeStyle codeStyle,
 	cgd = (*hostLang->makeCodeGen)( hostLang, args );
 
 	/* Code generation anlysis step. */
+	start = timeNow();
 	cgd->genAnalysis();
+	reportTime( "codegen-analysis", start );
 }
 
 #if 0
@@ -1476,6 +1895,13 @@ void ParseData::generateXML( ostream &out )
 }
 #endif
 
+void ParseData::clearDefGraphs()
+{
+	for ( DefGraphMap::Iter dg = defGraphs; dg.lte(); dg++ )
+		delete dg->value;
+	defGraphs.empty();
+}
+
 void ParseData::clear()
 {
 	cgd->clear();
@@ -37,6 +37,7 @@
 #include "vector.h"
 #include "parsetree.h"
 #include "nragel.h"
+#include "memusage.h"
 #include <libfsm/fsmgraph.h>
 #include <libfsm/common.h>
 #include <libfsm/action.h>
@@ -116,6 +117,10 @@ typedef AvlMap<std::string, int, CmpString> PriorDict;
 typedef AvlMapEl<std::string, int> LocalErrDictEl;
 typedef AvlMap<std::string, int, CmpString> LocalErrDict;
 
+/* Finished graphs of definitions, copied for repeat references. */
+typedef AvlMapEl<VarDef*, FsmAp*> DefGraphMapEl;
+typedef AvlMap<VarDef*, FsmAp*> DefGraphMap;
+
 /* Tree of instantiated names. */
 typedef AvlMapEl<std::string, NameMapVal*> NameMapEl;
 typedef AvlMap<std::string, NameMapVal*, CmpString> NameMap;
@@ -243,6 +248,10 @@ struct ParseData
 	/* Dictionary of named local errors. */
 	LocalErrDict localErrDict;
 
+	/* Graphs of definitions built during the walk. */
+	DefGraphMap defGraphs;
+	void clearDefGraphs();
+
 	/* Various next identifiers. */
 	int nextLocalErrKey, nextNameId;
 	
@@ -331,6 +340,43 @@ struct ParseData
 
 	CodeGenData *cgd;
 
+	/* Set once the machine is built and reduced. Sections may be prepared
+	 * ahead of output when compiling in parallel. */
+	bool prepared;
+	bool prepareSuccess;
+
+	/* Warnings issued while walking the parse tree. The graph cache does not
+	 * store a definition whose walk had something to say. */
+	int walkWarnings;
+	std::ostream &walkWarning( const InputLoc &loc );
+
+	/* Errors found while building the section. A section built on a worker
+	 * decides its failure from this count, not from the global one. */
+	int sectionErrors;
+	std::ostream &error( const InputLoc &loc );
+	std::ostream &error();
+
+	/* Add a step that began at start to the time report, if there is one. */
+	void reportTime( const char *phase, double start,
+			const std::string &name = std::string(), FsmAp *fsm = 0 );
+
+	/* Memory held by the graphs, largest per phase. Measured when statistics
+	 * are printed or there is a memory limit. */
+	MemPeakVect memPeaks;
+	bool accountMemory( const char *phase, FsmAp *fsm );
+	FsmRes checkMemLimit( FsmRes res );
+	void writeMemPeaks( std::ostream &out );
+
+	/* Where the memory limit was exceeded. The definition is the innermost
+	 * one being walked. */
+	bool memLimitHit;
+	FsmMemUsage memLimitUsage;
+	std::string memLimitDef;
+	InputLoc memLimitLoc;
+	long walkStateLimit();
+	void memLimitFailure( const FsmRes &res, const std::string &defName );
+	void reportMemLimit( const std::string &instName );
+
 	struct Cut
 	{
 		Cut( std::string name, int entryId )
@@ -366,6 +412,7 @@ void makeFsmUniqueKeyArray( KeySet &result, const char *data, int len,
 FsmAp *makeBuiltin( BuiltinMachine builtin, ParseData *pd );
 FsmAp *dotFsm( ParseData *pd );
 FsmAp *dotStarFsm( ParseData *pd );
+FsmRes unionParts( FsmAp **parts, int numParts );
 
 Key *prepareHexString( ParseData *pd, const InputLoc &loc,
 		const char *data, long length, long &resLen );
@@ -33,6 +33,7 @@
 #include <libfsm/action.h>
 #include "parsetree.h"
 #include "parsedata.h"
+#include "mergesort.h"
 
 using namespace std;
 ostream &operator<<( ostream &out, const NameRef &nameRef );
@@ -133,10 +134,44 @@ FsmRes VarDef::walk( ParseData *pd )
 	/* We enter into a new name scope. */
 	NameFrame nameFrame = pd->enterNameScope( true, 1 );
 
+	/* A definition that builds a plain graph is built once per section and
+	 * copied for the other references. It may also be in the graph cache.
+	 * Only a definition that was cacheable is in the memo, so the key is made
+	 * when the memo misses. */
+	GraphCache *graphCache = pd->id->graphCache;
+	GraphHash cacheKey;
+	bool cacheable = false;
+	FsmAp *fsm = 0;
+
+	DefGraphMapEl *built = pd->defGraphs.find( this );
+	if ( built != 0 )
+		fsm = new FsmAp( *built->value );
+	else {
+		cacheable = GraphCache::makeKey( pd, this, cacheKey );
+		if ( cacheable && graphCache != 0 ) {
+			fsm = graphCache->load( pd, cacheKey );
+			if ( fsm != 0 )
+				pd->defGraphs.insert( this, new FsmAp( *fsm ) );
+		}
+	}
+
+	if ( fsm != 0 ) {
+		if ( pd->curNameInst->numRefs > 0 )
+			fsm->setEntry( pd->curNameInst->id, fsm->startState );
+
+		pd->popNameScope( nameFrame );
+		return FsmRes( FsmRes::Fsm(), fsm );
+	}
+
+	int sectionErrors = pd->sectionErrors;
+	int walkWarnings = pd->walkWarnings;
+
 	/* Recurse on the expression. */
 	FsmRes rtnVal = machineDef->walk( pd );
-	if ( !rtnVal.success() )
+	if ( !rtnVal.success() ) {
+		pd->memLimitFailure( rtnVal, name );
 		return rtnVal;
+	}
 	
 	/* Do the tranfer of local error actions. */
 	LocalErrDictEl *localErrDictEl = pd->localErrDict.find( name );
@@ -159,6 +194,15 @@ FsmRes VarDef::walk( ParseData *pd )
 	/* We can now unset entry points that are not longer used. */
 	pd->unsetObsoleteEntries( rtnVal.fsm );
 
+	/* Only clean walks are kept, a copy cannot repeat diagnostics. */
+	if ( cacheable && pd->sectionErrors == sectionErrors &&
+			pd->walkWarnings == walkWarnings )
+	{
+		pd->defGraphs.insert( this, new FsmAp( *rtnVal.fsm ) );
+		if ( graphCache != 0 )
+			graphCache->store( pd, cacheKey, rtnVal.fsm );
+	}
+
 	/* If the name of the variable is referenced then add the entry point to
 	 * the graph. */
 	if ( pd->curNameInst->numRefs > 0 )
@@ -445,14 +489,11 @@ FsmRes LongestMatch::walkClassic( ParseData *pd )
 	for ( int i = 0; i < longestMatchList->length(); i++ )
 		transferScannerLeavingActions( parts[i] );
 
-	/* Union machines one and up with machine zero. The grammar dictates that
-	 * there will always be at least one part. */
-	FsmRes res( FsmRes::Fsm(), parts[0] );
-	for ( int i = 1; i < longestMatchList->length(); i++ ) {
-		res = FsmAp::unionOp( res.fsm, parts[i] );
-		if ( !res.success() )
-			return res;
-	}
+	/* Union the machines together. The grammar dictates that there will
+	 * always be at least one part. */
+	FsmRes res = unionParts( parts, longestMatchList->length() );
+	if ( !res.success() )
+		return res;
 
 	runLongestMatch( pd, res.fsm );
 
@@ -692,7 +733,7 @@ void Join::resolveNameRefs( ParseData *pd )
 			pd->curNameInst->start = resolved[0];
 			if ( resolved.length() > 1 ) {
 				/* Complain about the multiple references. */
-				pd->id->error(loc) << "join operation has multiple start labels" << endl;
+				pd->error(loc) << "join operation has multiple start labels" << endl;
 				pd->errorStateLabels( resolved );
 			}
 		}
@@ -704,7 +745,7 @@ void Join::resolveNameRefs( ParseData *pd )
 		}
 		else {
 			/* No start label. */
-			pd->id->error(loc) << "join operation has no start label" << endl;
+			pd->error(loc) << "join operation has no start label" << endl;
 		}
 
 		/* Recurse into all expressions in the list. */
@@ -729,27 +770,269 @@ Expression::~Expression()
 		delete term;
 }
 
-/* Evaluate a single expression node. */
-FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
+/* Minimize a machine that is built in steps, such as a repetition or a
+ * literal trie, at the minimization level asked for, unless minimization is
+ * off. */
+static void stepMinimize( ParseData *pd, FsmAp *fsm )
 {
-	switch ( type ) {
-		case OrType: {
-			/* Evaluate the expression. */
-			FsmRes exprFsm = expression->walk( pd, false );
-			if ( !exprFsm.success() )
-				return exprFsm;
+	if ( pd->id->minimizeOpt == MinimizeNone )
+		return;
 
-			/* Evaluate the term. */
-			FsmRes rhs = term->walk( pd );
-			if ( !rhs.success() )
-				return rhs;
+	switch ( pd->id->minimizeLevel ) {
+	case MinimizeApprox:
+		fsm->minimizeApproximate();
+		break;
+	case MinimizePartition1:
+		fsm->minimizePartition1();
+		break;
+	case MinimizePartition2:
+		fsm->minimizePartition2();
+		break;
+	case MinimizeStable:
+		fsm->minimizeStable();
+		break;
+	}
+}
 
-			/* Perform union. */
-			FsmRes res = FsmAp::unionOp( exprFsm.fsm, rhs.fsm, lastInSeq );
-			if ( !res.success() )
-				return res;
+/* Orders trie keys in the order of the alphabet type, which is the order
+ * transitions must be attached in. */
+struct CmpTrieKey
+{
+	CmpTrieKey() : keyOps(0) {}
+
+	int compare( const Key key1, const Key key2 )
+	{
+		if ( keyOps->lt( key1, key2 ) )
+			return -1;
+		else if ( keyOps->lt( key2, key1 ) )
+			return 1;
+		return 0;
+	}
+
+	KeyOps *keyOps;
+};
+
+struct LitTrieNode;
+typedef BstMapEl<Key, LitTrieNode*> LitTrieChildEl;
+typedef BstMap<Key, LitTrieNode*, CmpTrieKey> LitTrieChildren;
+
+/* A node of a trie of literals. */
+struct LitTrieNode
+{
+	LitTrieNode( KeyOps *keyOps ) : final(false), state(0)
+		{ children.keyOps = keyOps; }
+
+	LitTrieChildren children;
+	bool final;
+	StateAp *state;
+};
+
+/* Trie of the literals in a union. A case-insensitive trie stores letters in
+ * lower case and gives them transitions on both cases. */
+struct LitTrie
+{
+	LitTrie( KeyOps *keyOps, bool caseInsensitive )
+		: keyOps(keyOps), caseInsensitive(caseInsensitive), numLiterals(0)
+	{
+		nodes.append( new LitTrieNode( keyOps ) );
+	}
+
+	~LitTrie()
+	{
+		for ( Vector<LitTrieNode*>::Iter node = nodes; node.lte(); node++ )
+			delete *node;
+	}
+
+	void insert( const Key *keys, long length );
+	FsmAp *makeFsm( ParseData *pd );
+
+	KeyOps *keyOps;
+	bool caseInsensitive;
+	long numLiterals;
+	Vector<LitTrieNode*> nodes;
+};
 
+void LitTrie::insert( const Key *keys, long length )
+{
+	LitTrieNode *node = nodes[0];
+	for ( long k = 0; k < length; k++ ) {
+		Key key = keys[k];
+		if ( caseInsensitive && keyOps->le( 'A', key ) && keyOps->le( key, 'Z' ) )
+			key = keyOps->add( 'a', keyOps->sub( key, 'A' ) );
+
+		LitTrieChildEl *child = node->children.find( key );
+		if ( child == 0 ) {
+			LitTrieNode *next = new LitTrieNode( keyOps );
+			nodes.append( next );
+			child = node->children.insert( key, next );
+		}
+		node = child->value;
+	}
+
+	node->final = true;
+	numLiterals += 1;
+}
+
+/* Make the trie into a machine, one state per node. Minimizing it then shares
+ * the common suffixes. */
+FsmAp *LitTrie::makeFsm( ParseData *pd )
+{
+	FsmAp *fsm = FsmAp::emptyFsm( pd->fsmCtx );
+	nodes[0]->state = fsm->startState;
+	for ( long n = 1; n < nodes.length(); n++ )
+		nodes[n]->state = fsm->addState();
+
+	for ( Vector<LitTrieNode*>::Iter node = nodes; node.lte(); node++ ) {
+		if ( (*node)->final )
+			fsm->setFinState( (*node)->state );
+
+		LitTrieChildren both;
+		both.keyOps = keyOps;
+		LitTrieChildren *children = &(*node)->children;
+		if ( caseInsensitive ) {
+			for ( LitTrieChildren::Iter child = *children; child.lte(); child++ ) {
+				both.insert( child->key, child->value );
+				if ( keyOps->le( 'a', child->key ) && keyOps->le( child->key, 'z' ) )
+					both.insert( keyOps->add( 'A', keyOps->sub( child->key, 'a' ) ), child->value );
+			}
+			children = &both;
+		}
+
+		/* Transitions are attached in key order. */
+		for ( LitTrieChildren::Iter child = *children; child.lte(); child++ ) {
+			fsm->attachNewTrans( (*node)->state, child->value->state,
+					child->key, child->key );
+		}
+	}
+
+	stepMinimize( pd, fsm );
+	return fsm;
+}
+
+/* If a term is only a literal, with nothing attached to it, returns the
+ * literal. */
+static Literal *plainLiteral( Term *term )
+{
+	if ( term->type != Term::FactorWithAugType )
+		return 0;
+
+	FactorWithAug *fwa = term->factorWithAug;
+	if ( fwa->actions.length() > 0 || fwa->priorityAugs.length() > 0 ||
+			fwa->labels.size() > 0 || fwa->epsilonLinks.length() > 0 ||
+			fwa->conditions.length() > 0 )
+		return 0;
+
+	FactorWithRep *fwr = fwa->factorWithRep;
+	if ( fwr->type != FactorWithRep::FactorWithNegType )
+		return 0;
+
+	FactorWithNeg *fwn = fwr->factorWithNeg;
+	if ( fwn->type != FactorWithNeg::FactorType )
+		return 0;
+
+	if ( fwn->factor->type != Factor::LiteralType )
+		return 0;
+
+	return fwn->factor->literal;
+}
+
+/* Make the machine for a run of literals from a union. */
+static FsmRes literalUnion( ParseData *pd, Literal **literals, long numLiterals )
+{
+	KeyOps *keyOps = pd->fsmCtx->keyOps;
+	LitTrie plain( keyOps, false ), folded( keyOps, true );
+	for ( long l = 0; l < numLiterals; l++ ) {
+		long length;
+		bool caseInsensitive;
+		Key *arr = literals[l]->makeKeys( pd, length, caseInsensitive );
+		if ( caseInsensitive )
+			folded.insert( arr, length );
+		else
+			plain.insert( arr, length );
+		delete[] arr;
+	}
+
+	if ( folded.numLiterals == 0 )
+		return FsmRes( FsmRes::Fsm(), plain.makeFsm( pd ) );
+	if ( plain.numLiterals == 0 )
+		return FsmRes( FsmRes::Fsm(), folded.makeFsm( pd ) );
+
+	return FsmAp::unionOp( plain.makeFsm( pd ), folded.makeFsm( pd ) );
+}
+
+/* Evaluate a union. The union is a left recursive list, so its terms are
+ * collected and walked first to last. Runs of two or more plain literals are
+ * built into a single trie rather than one union per literal. */
+FsmRes Expression::walkUnion( ParseData *pd, bool lastInSeq )
+{
+	Vector<Term*> terms;
+	Expression *first = this;
+	for ( ; first->type == OrType; first = first->expression )
+		terms.append( first->term );
+
+	FsmAp *fsm = 0;
+	if ( first->type == TermType )
+		terms.append( first->term );
+	else {
+		FsmRes firstFsm = first->walk( pd, false );
+		if ( !firstFsm.success() )
+			return firstFsm;
+		fsm = firstFsm.fsm;
+	}
+
+	/* Terms were collected last to first. */
+	Vector<Literal*> literals;
+	long t = terms.length() - 1;
+	while ( t >= 0 ) {
+		literals.empty();
+		for ( long r = t; r >= 0; r-- ) {
+			Literal *literal = plainLiteral( terms[r] );
+			if ( literal == 0 )
+				break;
+			literals.append( literal );
+		}
+
+		FsmRes part( FsmRes::Fsm(), 0 );
+		if ( literals.length() >= 2 ) {
+			part = literalUnion( pd, literals.data, literals.length() );
+			t -= literals.length();
+		}
+		else {
+			/* As when recursing, the first term is not last in sequence. */
+			bool firstTerm = first->type == TermType && t == terms.length() - 1;
+			part = terms[t]->walk( pd, !firstTerm );
+			t -= 1;
+		}
+
+		if ( !part.success() )
+			return part;
+
+		if ( fsm == 0 ) {
+			fsm = part.fsm;
+			continue;
+		}
+
+		/* Perform union. */
+		FsmRes res = FsmAp::unionOp( fsm, part.fsm, t < 0 ? lastInSeq : false );
+		if ( !res.success() )
+			return res;
+
+		res = pd->checkMemLimit( res );
+		if ( !res.success() )
 			return res;
+
+		fsm = res.fsm;
+	}
+
+	return FsmRes( FsmRes::Fsm(), fsm );
+}
+
+/* Evaluate a single expression node. */
+FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
+{
+	switch ( type ) {
+		case OrType: {
+			return walkUnion( pd, lastInSeq );
 		}
 		case IntersectType: {
 			/* Evaluate the expression. */
@@ -767,7 +1050,7 @@ FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() )
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case SubtractType: {
 			/* Evaluate the expression. */
@@ -785,7 +1068,7 @@ FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() )
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case StrongSubtractType: {
 			/* Evaluate the expression. */
@@ -814,7 +1097,7 @@ FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
 			if ( !res3.success() )
 				return res3;
 
-			return res3;
+			return pd->checkMemLimit( res3 );
 		}
 		case TermType: {
 			/* Return result of the term. */
@@ -896,7 +1179,7 @@ FsmRes Term::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() )
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case RightStartType: {
 			/* Evaluate the Term. */
@@ -916,7 +1199,7 @@ FsmRes Term::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() )
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case RightFinishType: {
 			/* Evaluate the Term. */
@@ -957,7 +1240,7 @@ FsmRes Term::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() ) 
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case LeftType: {
 			/* Evaluate the Term. */
@@ -992,7 +1275,7 @@ FsmRes Term::walk( ParseData *pd, bool lastInSeq )
 			if ( !res.success() )
 				return res;
 
-			return res;
+			return pd->checkMemLimit( res );
 		}
 		case FactorWithAugType: {
 			return factorWithAug->walk( pd );
@@ -1394,7 +1677,7 @@ void FactorWithAug::resolveNameRefs( ParseData *pd )
 				resolvedName = resolved[0];
 				if ( resolved.length() > 1 ) {
 					/* Complain about the multiple references. */
-					pd->id->error(link.loc) << "state reference " << link.target << 
+					pd->error(link.loc) << "state reference " << link.target << 
 							" resolves to multiple entry points" << endl;
 					pd->errorStateLabels( resolved );
 				}
@@ -1414,7 +1697,7 @@ void FactorWithAug::resolveNameRefs( ParseData *pd )
 		else {
 			/* Complain, no recovery action, the epsilon op will ignore any
 			 * epsilon transitions whose names did not resolve. */
-			pd->id->error(link.loc) << "could not resolve label " << link.target << endl;
+			pd->error(link.loc) << "could not resolve label " << link.target << endl;
 		}
 	}
 
@@ -1437,6 +1720,115 @@ FactorWithRep::~FactorWithRep()
 }
 
 
+/* Concatenate n copies of a machine by repeated doubling, so the number of
+ * steps grows with log(n). Takes the machine. Requires n >= 1. Each step is
+ * held to the memory limit. A failed concatenation consumes its operands, the
+ * other partial machine is freed here. */
+static FsmRes doublingRepeat( ParseData *pd, FsmAp *fsm, int n )
+{
+	FsmAp *result = 0;
+	FsmAp *power = fsm;
+	while ( true ) {
+		if ( n & 1 ) {
+			if ( result == 0 )
+				result = new FsmAp( *power );
+			else {
+				FsmRes res = pd->checkMemLimit(
+						FsmAp::concatOp( result, new FsmAp( *power ) ) );
+				if ( !res.success() ) {
+					delete power;
+					return res;
+				}
+				result = res.fsm;
+				stepMinimize( pd, result );
+			}
+		}
+
+		n >>= 1;
+		if ( n == 0 )
+			break;
+
+		FsmRes res = pd->checkMemLimit(
+				FsmAp::concatOp( power, new FsmAp( *power ) ) );
+		if ( !res.success() ) {
+			if ( result != 0 )
+				delete result;
+			return res;
+		}
+		power = res.fsm;
+		stepMinimize( pd, power );
+	}
+
+	delete power;
+	return FsmRes( FsmRes::Fsm(), result );
+}
+
+/* The optional copies made by maxRepeatOp and rangeRepeatOp leave the final
+ * states of earlier copies final, along with their pending out data.
+ * Concatenation moves that data onto the next copy. The two agree only when
+ * there is none. */
+static bool noPendingOut( FsmAp *fsm )
+{
+	for ( StateSet::Iter st = fsm->finStateSet; st.lte(); st++ ) {
+		if ( (*st)->outActionTable.length() > 0 || (*st)->outCondSpace != 0 ||
+				(*st)->outPriorTable.length() > 0 )
+			return false;
+	}
+	return true;
+}
+
+/* A machine with pending out data goes through exactRepeatOp, which orders
+ * the out actions of one copy ahead of the entering actions of the next.
+ * Otherwise double, after shifting the start actions the same way
+ * exactRepeatOp does. */
+static FsmRes exactRepeat( ParseData *pd, FsmAp *fsm, int times )
+{
+	if ( times < 2 || !noPendingOut( fsm ) )
+		return FsmAp::exactRepeatOp( fsm, times );
+
+	pd->fsmCtx->curActionOrd += fsm->shiftStartActionOrder( pd->fsmCtx->curActionOrd );
+	return doublingRepeat( pd, fsm, times );
+}
+
+static FsmRes maxRepeat( ParseData *pd, FsmAp *fsm, int times )
+{
+	if ( times < 2 || !noPendingOut( fsm ) )
+		return FsmAp::maxRepeatOp( fsm, times );
+
+	/* One optional copy, then double that. */
+	FsmRes one = FsmAp::maxRepeatOp( fsm, 1 );
+	if ( !one.success() )
+		return one;
+	return doublingRepeat( pd, one.fsm, times );
+}
+
+static FsmRes rangeRepeat( ParseData *pd, FsmAp *fsm, int lower, int upper )
+{
+	if ( upper < 2 || !noPendingOut( fsm ) )
+		return FsmAp::rangeRepeatOp( fsm, lower, upper );
+
+	if ( lower == 0 )
+		return maxRepeat( pd, fsm, upper );
+
+	if ( lower == upper )
+		return exactRepeat( pd, fsm, lower );
+
+	FsmAp *optional = new FsmAp( *fsm );
+	FsmRes required = exactRepeat( pd, fsm, lower );
+	if ( !required.success() ) {
+		delete optional;
+		return required;
+	}
+
+	FsmRes rest = maxRepeat( pd, optional, upper - lower );
+	if ( !rest.success() ) {
+		delete required.fsm;
+		return rest;
+	}
+
+	return FsmAp::concatOp( required.fsm, rest.fsm );
+}
+
 /* Evaluate a factor with repetition node. */
 FsmRes FactorWithRep::walk( ParseData *pd )
 {
@@ -1448,12 +1840,12 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			return factorTree;
 		
 		if ( factorTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying kleene star to a machine that "
+			pd->walkWarning(loc) << "applying kleene star to a machine that "
 					"accepts zero length word" << endl;
 			factorTree.fsm->unsetFinState( factorTree.fsm->startState );
 		}
 
-		return FsmAp::starOp( factorTree.fsm );
+		return pd->checkMemLimit( FsmAp::starOp( factorTree.fsm ) );
 	}
 	case StarStarType: {
 		/* Evaluate the FactorWithRep. */
@@ -1462,7 +1854,7 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			return factorTree;
 
 		if ( factorTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying kleene star to a machine that "
+			pd->walkWarning(loc) << "applying kleene star to a machine that "
 					"accepts zero length word" << endl;
 		}
 
@@ -1478,7 +1870,7 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		priorDescs[1].priority = 0;
 		factorTree.fsm->leaveFsmPrior( pd->fsmCtx->curPriorOrd++, &priorDescs[1] );
 
-		return FsmAp::starOp( factorTree.fsm );
+		return pd->checkMemLimit( FsmAp::starOp( factorTree.fsm ) );
 	}
 	case OptionalType: {
 		/* Evaluate the FactorWithRep. */
@@ -1486,7 +1878,7 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		if ( !factorTree.success() )
 			return factorTree;
 
-		return FsmAp::questionOp( factorTree.fsm );
+		return pd->checkMemLimit( FsmAp::questionOp( factorTree.fsm ) );
 	}
 	case PlusType: {
 		/* Evaluate the FactorWithRep. */
@@ -1495,11 +1887,11 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			return factorTree;
 
 		if ( factorTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying plus operator to a machine that "
+			pd->walkWarning(loc) << "applying plus operator to a machine that "
 					"accepts zero length word" << endl;
 		}
 
-		return FsmAp::plusOp( factorTree.fsm );
+		return pd->checkMemLimit( FsmAp::plusOp( factorTree.fsm ) );
 	}
 	case ExactType: {
 		/* Evaluate the first FactorWithRep. */
@@ -1511,18 +1903,18 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		if ( lowerRep == 0 ) {
 			/* No copies. Don't need to evaluate the factorWithRep. 
 			 * This Defeats the purpose so give a warning. */
-			pd->id->warning(loc) << "exactly zero repetitions results "
+			pd->walkWarning(loc) << "exactly zero repetitions results "
 					"in the null machine" << endl;
 		}
 		else {
 			if ( factorTree.fsm->startState->isFinState() ) {
-				pd->id->warning(loc) << "applying repetition to a machine that "
+				pd->walkWarning(loc) << "applying repetition to a machine that "
 						"accepts zero length word" << endl;
 			}
 		}
 
 		/* Handles the n == 0 case. */
-		return FsmAp::exactRepeatOp( factorTree.fsm, lowerRep );
+		return pd->checkMemLimit( exactRepeat( pd, factorTree.fsm, lowerRep ) );
 	}
 	case MaxType: {
 		/* Evaluate the first FactorWithRep. */
@@ -1534,7 +1926,7 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		if ( upperRep == 0 ) {
 			/* No copies. Don't need to evaluate the factorWithRep. 
 			 * This Defeats the purpose so give a warning. */
-			pd->id->warning(loc) << "max zero repetitions results "
+			pd->walkWarning(loc) << "max zero repetitions results "
 					"in the null machine" << endl;
 
 			return FsmRes( FsmRes::Fsm(), FsmAp::lambdaFsm( pd->fsmCtx ) );
@@ -1542,13 +1934,13 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		else {
 
 			if ( factorTree.fsm->startState->isFinState() ) {
-				pd->id->warning(loc) << "applying max repetition to a machine that "
+				pd->walkWarning(loc) << "applying max repetition to a machine that "
 						"accepts zero length word" << endl;
 			}
 		}
 			
 		/* Do the repetition on the machine. Handles the n == 0 case. */
-		return FsmAp::maxRepeatOp( factorTree.fsm, upperRep );
+		return pd->checkMemLimit( maxRepeat( pd, factorTree.fsm, upperRep ) );
 	}
 	case MinType: {
 		/* Evaluate the repeated machine. */
@@ -1557,16 +1949,16 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			return factorTree;
 
 		if ( factorTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying min repetition to a machine that "
+			pd->walkWarning(loc) << "applying min repetition to a machine that "
 					"accepts zero length word" << endl;
 		}
 	
-		return FsmAp::minRepeatOp( factorTree.fsm, lowerRep ); 
+		return pd->checkMemLimit( FsmAp::minRepeatOp( factorTree.fsm, lowerRep ) );
 	}
 	case RangeType: {
 		/* Check for bogus range. */
 		if ( upperRep - lowerRep < 0 ) {
-			pd->id->error(loc) << "invalid range repetition" << endl;
+			pd->error(loc) << "invalid range repetition" << endl;
 
 			/* Return null machine as recovery. */
 			return FsmRes( FsmRes::Fsm(), FsmAp::lambdaFsm( pd->fsmCtx ) );
@@ -1580,18 +1972,18 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 		if ( lowerRep == 0 && upperRep == 0 ) {
 			/* No copies. Don't need to evaluate the factorWithRep.  This
 			 * defeats the purpose so give a warning. */
-			pd->id->warning(loc) << "zero to zero repetitions results "
+			pd->walkWarning(loc) << "zero to zero repetitions results "
 					"in the null machine" << endl;
 		}
 		else {
 
 			if ( factorTree.fsm->startState->isFinState() ) {
-				pd->id->warning(loc) << "applying range repetition to a machine that "
+				pd->walkWarning(loc) << "applying range repetition to a machine that "
 						"accepts zero length word" << endl;
 			}
 
 		}
-		return FsmAp::rangeRepeatOp( factorTree.fsm, lowerRep, upperRep );
+		return pd->checkMemLimit( rangeRepeat( pd, factorTree.fsm, lowerRep, upperRep ) );
 	}
 	case FactorWithNegType: {
 		/* Evaluate the Factor. Pass it up. */
@@ -1807,7 +2199,7 @@ FsmRes Factor::walk( ParseData *pd )
 			return exprTree;
 
 		if ( exprTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying plus operator to a machine that "
+			pd->walkWarning(loc) << "applying plus operator to a machine that "
 					"accepts zero length word" << endl;
 		}
 
@@ -1819,7 +2211,7 @@ FsmRes Factor::walk( ParseData *pd )
 			return exprTree;
 
 		if ( exprTree.fsm->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying plus operator to a machine that "
+			pd->walkWarning(loc) << "applying plus operator to a machine that "
 					"accepts zero length word" << endl;
 		}
 
@@ -1894,14 +2286,14 @@ FsmAp *Range::walk( ParseData *pd )
 	/* Construct and verify the suitability of the lower end of the range. */
 	FsmAp *lowerFsm = lowerLit->walk( pd );
 	if ( !lowerFsm->checkSingleCharMachine() ) {
-		pd->id->error(lowerLit->loc) << 
+		pd->error(lowerLit->loc) << 
 			"bad range lower end, must be a single character" << endl;
 	}
 
 	/* Construct and verify the upper end. */
 	FsmAp *upperFsm = upperLit->walk( pd );
 	if ( !upperFsm->checkSingleCharMachine() ) {
-		pd->id->error(upperLit->loc) << 
+		pd->error(upperLit->loc) << 
 			"bad range upper end, must be a single character" << endl;
 	}
 
@@ -1914,7 +2306,7 @@ FsmAp *Range::walk( ParseData *pd )
 	/* Validate the range. */
 	if ( pd->fsmCtx->keyOps->gt( lowKey, highKey ) ) {
 		/* Recover by setting upper to lower; */
-		pd->id->error(lowerLit->loc) << "lower end of range is greater then upper end" << endl;
+		pd->error(lowerLit->loc) << "lower end of range is greater then upper end" << endl;
 		highKey = lowKey;
 	}
 
@@ -1928,11 +2320,10 @@ FsmAp *Range::walk( ParseData *pd )
 	return retFsm;
 }
 
-/* Evaluate a literal object. */
-FsmAp *Literal::walk( ParseData *pd )
+/* Make the keys of a literal. Returns a new array. */
+Key *Literal::makeKeys( ParseData *pd, long &length, bool &caseInsensitive )
 {
-	/* FsmAp to return, is the alphabet signed. */
-	FsmAp *rtnVal = 0;
+	caseInsensitive = false;
 
 	switch ( type ) {
 	case Number: {
@@ -1943,37 +2334,43 @@ FsmAp *Literal::walk( ParseData *pd )
 		num.append( 0 );
 
 		/* Make the fsm key in int format. */
-		Key fsmKey = makeFsmKeyNum( num.data, loc, pd );
-
-		/* Make the new machine. */
-		rtnVal = FsmAp::concatFsm( pd->fsmCtx, fsmKey );
-		break;
+		length = 1;
+		Key *arr = new Key[1];
+		arr[0] = makeFsmKeyNum( num.data, loc, pd );
+		return arr;
 	}
 	case LitString: {
 		/* Make the array of keys in int format. */
-		long length;
-		bool caseInsensitive;
 		char *litstr = prepareLitString( pd->id, loc, data.data, data.length(), 
 				length, caseInsensitive );
 		Key *arr = new Key[length];
 		makeFsmKeyArray( arr, litstr, length, pd );
-
-		/* Make the new machine. */
-		if ( caseInsensitive )
-			rtnVal = FsmAp::concatFsmCI( pd->fsmCtx, arr, length );
-		else
-			rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, length );
 		delete[] litstr;
-		delete[] arr;
-		break;
+		return arr;
 	}
 	case HexString: {
-		long length;
-		Key *arr = prepareHexString( pd, loc, data.data, data.length(), length );
-		rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, length );
-		delete[] arr;
-		break;
+		return prepareHexString( pd, loc, data.data, data.length(), length );
 	}}
+
+	length = 0;
+	return 0;
+}
+
+/* Evaluate a literal object. */
+FsmAp *Literal::walk( ParseData *pd )
+{
+	long length;
+	bool caseInsensitive;
+	Key *arr = makeKeys( pd, length, caseInsensitive );
+
+	/* Make the new machine. */
+	FsmAp *rtnVal;
+	if ( caseInsensitive )
+		rtnVal = FsmAp::concatFsmCI( pd->fsmCtx, arr, length );
+	else
+		rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, length );
+
+	delete[] arr;
 	return rtnVal;
 }
 
@@ -2079,7 +2476,7 @@ FsmRes ReItem::walk( ParseData *pd, RegExpr *rootRegex )
 	/* If the item is followed by a star, then apply the star op. */
 	if ( star ) {
 		if ( rtnVal->startState->isFinState() ) {
-			pd->id->warning(loc) << "applying kleene star to a machine that "
+			pd->walkWarning(loc) << "applying kleene star to a machine that "
 					"accepts zero length word" << endl;
 		}
 
@@ -2105,39 +2502,78 @@ ReOrBlock::~ReOrBlock()
 }
 
 
-/* Evaluate an or block of a regular expression. */
-FsmAp *ReOrBlock::walk( ParseData *pd, RegExpr *rootRegex )
+/* Orders ranges by their low key, in the order of the alphabet type. */
+struct CmpClassRange
 {
-	FsmAp *rtnVal = 0;
-	switch ( type ) {
-		case RecurseItem: {
-			/* Evaluate the two fsm. */
-			FsmAp *fsm1 = orBlock->walk( pd, rootRegex );
-			FsmAp *fsm2 = item->walk( pd, rootRegex );
-			if ( fsm1 == 0 )
-				rtnVal = fsm2;
-			else {
-				FsmRes res = FsmAp::unionOp( fsm1, fsm2 );
-				fsm1 = res.fsm;
-				rtnVal = fsm1;
-			}
-			break;
-		}
-		case Empty: {
-			rtnVal = 0;
-			break;
+	CmpClassRange() : keyOps(0) {}
+
+	int compare( const ClassRange &r1, const ClassRange &r2 )
+	{
+		if ( keyOps->lt( r1.lowKey, r2.lowKey ) )
+			return -1;
+		else if ( keyOps->lt( r2.lowKey, r1.lowKey ) )
+			return 1;
+		return 0;
+	}
+
+	KeyOps *keyOps;
+};
+
+/* Make the machine for a set of ranges. The ranges are sorted and the ones
+ * that overlap or touch are merged, then they all go on the transitions of a
+ * single start state to a single final state. */
+static FsmAp *classFsm( ParseData *pd, ClassRangeVect &ranges )
+{
+	KeyOps *keyOps = pd->fsmCtx->keyOps;
+
+	MergeSort<ClassRange, CmpClassRange> mergeSort;
+	mergeSort.keyOps = keyOps;
+	mergeSort.sort( ranges.data, ranges.length() );
+
+	FsmAp *fsm = FsmAp::emptyFsm( pd->fsmCtx );
+	StateAp *finState = fsm->addState();
+	fsm->setFinState( finState );
+
+	long r = 0;
+	while ( r < ranges.length() ) {
+		Key lowKey = ranges[r].lowKey;
+		Key highKey = ranges[r].highKey;
+		for ( r += 1; r < ranges.length(); r++ ) {
+			/* Stop at a gap. Every range touches one that ends on the
+			 * largest key. */
+			if ( keyOps->lt( highKey, keyOps->maxKey ) &&
+					keyOps->gt( ranges[r].lowKey, keyOps->add( highKey, 1 ) ) )
+				break;
+			if ( keyOps->gt( ranges[r].highKey, highKey ) )
+				highKey = ranges[r].highKey;
 		}
+
+		fsm->attachNewTrans( fsm->startState, finState, lowKey, highKey );
 	}
-	return rtnVal;;
+
+	return fsm;
 }
 
-/* Evaluate an or block item of a regular expression. */
-FsmAp *ReOrItem::walk( ParseData *pd, RegExpr *rootRegex )
+/* Evaluate an or block of a regular expression. */
+FsmAp *ReOrBlock::walk( ParseData *pd, RegExpr *rootRegex )
+{
+	/* The block is a left recursive list. The order of the items does not
+	 * matter once their ranges are sorted. */
+	ClassRangeVect ranges;
+	for ( ReOrBlock *block = this; block->type == RecurseItem; block = block->orBlock )
+		block->item->collect( pd, rootRegex, ranges );
+
+	if ( ranges.length() == 0 )
+		return 0;
+
+	return classFsm( pd, ranges );
+}
+
+/* Add the ranges of an or block item of a regular expression. */
+void ReOrItem::collect( ParseData *pd, RegExpr *rootRegex, ClassRangeVect &ranges )
 {
 	KeyOps *keyOps = pd->fsmCtx->keyOps;
 
-	/* The return value, is the alphabet signed? */
-	FsmAp *rtnVal = 0;
 	switch ( type ) {
 	case Data: {
 		/* Put the or data into an array of ints. Note that we find unique
@@ -2148,8 +2584,8 @@ FsmAp *ReOrItem::walk( ParseData *pd, RegExpr *rootRegex )
 		makeFsmUniqueKeyArray( keySet, data.data, data.length(), 
 			rootRegex != 0 ? rootRegex->caseInsensitive : false, pd );
 
-		/* Run the or operator. */
-		rtnVal = FsmAp::orFsm( pd->fsmCtx, keySet.data, keySet.length() );
+		for ( int k = 0; k < keySet.length(); k++ )
+			ranges.append( ClassRange( keySet.data[k], keySet.data[k] ) );
 		break;
 	}
 	case Range: {
@@ -2160,12 +2596,11 @@ FsmAp *ReOrItem::walk( ParseData *pd, RegExpr *rootRegex )
 		/* Validate the range. */
 		if ( keyOps->gt( lowKey, highKey ) ) {
 			/* Recover by setting upper to lower; */
-			pd->id->error(loc) << "lower end of range is greater then upper end" << endl;
+			pd->error(loc) << "lower end of range is greater then upper end" << endl;
 			highKey = lowKey;
 		}
 
-		/* Make the range machine. */
-		rtnVal = FsmAp::rangeFsm( pd->fsmCtx, lowKey, highKey );
+		ranges.append( ClassRange( lowKey, highKey ) );
 
 		if ( rootRegex != 0 && rootRegex->caseInsensitive ) {
 			if ( keyOps->le( lowKey, 'Z' ) && pd->fsmCtx->keyOps->le( 'A', highKey ) ) {
@@ -2175,10 +2610,7 @@ FsmAp *ReOrItem::walk( ParseData *pd, RegExpr *rootRegex )
 				otherLow = keyOps->add( 'a', ( keyOps->sub( otherLow, 'A' ) ) );
 				otherHigh = keyOps->add( 'a', ( keyOps->sub( otherHigh, 'A' ) ) );
 
-				FsmAp *otherRange = FsmAp::rangeFsm( pd->fsmCtx, otherLow, otherHigh );
-				FsmRes res = FsmAp::unionOp( rtnVal, otherRange );
-				rtnVal = res.fsm;
-				rtnVal->minimizePartition2();
+				ranges.append( ClassRange( otherLow, otherHigh ) );
 			}
 			else if ( keyOps->le( lowKey, 'z' ) && keyOps->le( 'a', highKey ) ) {
 				Key otherLow = keyOps->lt( lowKey, 'a' ) ? Key('a') : lowKey;
@@ -2187,14 +2619,10 @@ FsmAp *ReOrItem::walk( ParseData *pd, RegExpr *rootRegex )
 				otherLow = keyOps->add('A' , ( keyOps->sub( otherLow , 'a' ) ));
 				otherHigh = keyOps->add('A' , ( keyOps->sub( otherHigh , 'a' ) ));
 
-				FsmAp *otherRange = FsmAp::rangeFsm( pd->fsmCtx, otherLow, otherHigh );
-				FsmRes res = FsmAp::unionOp( rtnVal, otherRange );
-				rtnVal = res.fsm;
-				rtnVal->minimizePartition2();
+				ranges.append( ClassRange( otherLow, otherHigh ) );
 			}
 		}
 
 		break;
 	}}
-	return rtnVal;
 }
@@ -77,6 +77,7 @@ struct Range;
 struct LengthDef;
 struct colm_data;
 struct colm_location;
+struct GraphHash;
 
 /* Type of augmentation. Describes locations in the machine. */
 enum AugType
@@ -249,6 +250,7 @@ struct VarDef
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( const InputLoc &loc, ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	std::string name;
 	MachineDef *machineDef;
@@ -343,6 +345,7 @@ struct LongestMatch
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
 	void transferScannerLeavingActions( FsmAp *graph );
+	void fillItemSets( FsmAp *graph );
 	void runLongestMatch( ParseData *pd, FsmAp *graph );
 	Action *newLmAction( ParseData *pd, const InputLoc &loc, const char *name, 
 			InlineList *inlineList );
@@ -386,6 +389,7 @@ struct MachineDef
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 	
 	Join *join;
 	LongestMatch *longestMatch;
@@ -413,6 +417,7 @@ struct Join
 	FsmRes walkJoin( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	/* Data. */
 	InputLoc loc;
@@ -452,8 +457,10 @@ struct Expression
 
 	/* Tree traversal. */
 	FsmRes walk( ParseData *pd, bool lastInSeq = true );
+	FsmRes walkUnion( ParseData *pd, bool lastInSeq );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	/* Node data. */
 	Expression *expression;
@@ -522,6 +529,7 @@ struct Term
 	FsmRes walk( ParseData *pd, bool lastInSeq = true );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	Action *action1;
 	Action *action2;
@@ -552,6 +560,7 @@ struct FactorWithAug
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	void assignActions( ParseData *pd, FsmAp *graph, int *actionOrd );
 	void assignPriorities( FsmAp *graph, int *priorOrd );
@@ -603,6 +612,7 @@ struct FactorWithRep
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	InputLoc loc;
 	long long repId;
@@ -636,6 +646,7 @@ struct FactorWithNeg
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	InputLoc loc;
 	FactorWithNeg *factorWithNeg;
@@ -714,6 +725,7 @@ struct Factor
 	FsmRes walk( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
+	bool hashTree( ParseData *pd, GraphHash &hash );
 
 	InputLoc loc;
 	Literal *literal;
@@ -746,6 +758,7 @@ struct Range
 
 	~Range();
 	FsmAp *walk( ParseData *pd );
+	bool hashTree( GraphHash &hash );
 
 	Literal *lowerLit;
 	Literal *upperLit;
@@ -764,6 +777,8 @@ struct Literal
 	}
 
 	FsmAp *walk( ParseData *pd );
+	Key *makeKeys( ParseData *pd, long &length, bool &caseInsensitive );
+	bool hashTree( GraphHash &hash );
 	
 	InputLoc loc;
 	bool neg;
@@ -785,6 +800,7 @@ struct RegExpr
 
 	~RegExpr();
 	FsmAp *walk( ParseData *pd, RegExpr *rootRegex );
+	bool hashTree( GraphHash &hash );
 
 	RegExpr *regExpr;
 	ReItem *item;
@@ -812,6 +828,7 @@ struct ReItem
 
 	~ReItem();
 	FsmRes walk( ParseData *pd, RegExpr *rootRegex );
+	bool hashTree( GraphHash &hash );
 
 	InputLoc loc;
 	Vector<char> data;
@@ -820,6 +837,18 @@ struct ReItem
 	ReItemType type;
 };
 
+/* A range of keys in an or block, before the block's ranges are merged. */
+struct ClassRange
+{
+	ClassRange( Key lowKey, Key highKey )
+		: lowKey(lowKey), highKey(highKey) { }
+
+	Key lowKey;
+	Key highKey;
+};
+
+typedef Vector<ClassRange> ClassRangeVect;
+
 /* An or block item. */
 struct ReOrBlock
 {
@@ -833,6 +862,7 @@ struct ReOrBlock
 
 	~ReOrBlock();
 	FsmAp *walk( ParseData *pd, RegExpr *rootRegex );
+	bool hashTree( GraphHash &hash );
 	
 	ReOrBlock *orBlock;
 	ReOrItem *item;
@@ -854,7 +884,8 @@ struct ReOrItem
 	ReOrItem( const InputLoc &loc, char lower, char upper )
 		: loc(loc), lower(lower), upper(upper), type(Range) { }
 
-	FsmAp *walk( ParseData *pd, RegExpr *rootRegex );
+	void collect( ParseData *pd, RegExpr *rootRegex, ClassRangeVect &ranges );
+	bool hashTree( GraphHash &hash );
 
 	InputLoc loc;
 	Vector<char> data;
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "profile.h"
+
+#include <sstream>
+#include <algorithm>
+
+/* Orders state ids by count, highest first, then by id. */
+struct CmpStateCount
+{
+	CmpStateCount( const std::vector<unsigned long long> &counts ) : counts(counts) {}
+
+	bool operator()( long s1, long s2 ) const
+	{
+		if ( counts[s1] != counts[s2] )
+			return counts[s1] > counts[s2];
+		return s1 < s2;
+	}
+
+	const std::vector<unsigned long long> &counts;
+};
+
+std::vector<long> ProfileMachine::hotOrder() const
+{
+	std::vector<long> order( states.size() );
+	for ( size_t s = 0; s < states.size(); s++ )
+		order[s] = s;
+
+	std::sort( order.begin(), order.end(), CmpStateCount( states ) );
+	return order;
+}
+
+long ProfileMachine::hotStates( double share ) const
+{
+	unsigned long long total = 0;
+	for ( size_t s = 0; s < states.size(); s++ )
+		total += states[s];
+
+	if ( total == 0 )
+		return 0;
+
+	std::vector<long> order = hotOrder();
+	unsigned long long covered = 0;
+	long n = 0;
+	while ( n < (long)order.size() && covered < share * total )
+		covered += states[order[n++]];
+
+	return n;
+}
+
+/* Reads an unsigned count. A stream reads "-1" into an unsigned type by
+ * wrapping it, so a sign is rejected first. */
+static bool readCount( std::istream &fields, unsigned long long &count )
+{
+	fields >> std::ws;
+	if ( fields.peek() == '-' || fields.peek() == '+' )
+		return false;
+	return (bool)( fields >> count );
+}
+
+static bool readError( std::string &error, long line, const std::string &what )
+{
+	std::stringstream out;
+	out << "line " << line << ": " << what;
+	error = out.str();
+	return false;
+}
+
+bool Profile::read( std::istream &in, std::string &error )
+{
+	std::string text;
+	long line = 0;
+	ProfileMachine *machine = 0;
+	bool header = false;
+
+	while ( std::getline( in, text ) ) {
+		line += 1;
+
+		std::istringstream fields( text );
+		std::string record;
+		if ( !( fields >> record ) )
+			continue;
+
+		/* The first record, wherever it falls, must be the header. */
+		if ( !header ) {
+			int version;
+			if ( record != "ragel-profile" || !( fields >> version ) || version != 1 )
+				return readError( error, line, "not a version 1 ragel profile" );
+			header = true;
+			continue;
+		}
+
+		if ( record == "machine" ) {
+			std::string name;
+			long numStates;
+			if ( machine != 0 )
+				return readError( error, line, "machine inside machine " + machine->name );
+			if ( !( fields >> name >> numStates ) || numStates < 0 )
+				return readError( error, line, "expecting machine NAME NUM-STATES" );
+
+			machines.push_back( ProfileMachine() );
+			machine = &machines.back();
+			machine->name = name;
+			machine->states.resize( numStates, 0 );
+			continue;
+		}
+
+		if ( machine == 0 )
+			return readError( error, line, "\"" + record + "\" outside of a machine" );
+
+		if ( record == "end" ) {
+			machine = 0;
+		}
+		else if ( record == "state" ) {
+			long id;
+			unsigned long long count;
+			if ( !( fields >> id ) || !readCount( fields, count ) ||
+					id < 0 || id >= (long)machine->states.size() )
+				return readError( error, line, "bad state record" );
+			machine->states[id] = count;
+		}
+		else if ( record == "trans" ) {
+			ProfileTrans trans;
+			if ( !( fields >> trans.state >> trans.lowKey >> trans.highKey ) ||
+					!readCount( fields, trans.count ) ||
+					trans.state < 0 || trans.state >= (long)machine->states.size() ||
+					trans.lowKey > trans.highKey )
+				return readError( error, line, "bad trans record" );
+			machine->trans.push_back( trans );
+		}
+		else if ( record == "action" ) {
+			long id;
+			unsigned long long count;
+			if ( !( fields >> id ) || !readCount( fields, count ) || id < 0 )
+				return readError( error, line, "bad action record" );
+			if ( id >= (long)machine->actions.size() )
+				machine->actions.resize( id + 1, 0 );
+			machine->actions[id] = count;
+		}
+		else if ( record == "eof" ) {
+			if ( !readCount( fields, machine->eofExits ) )
+				return readError( error, line, "bad eof record" );
+		}
+		else if ( record == "error" ) {
+			if ( !readCount( fields, machine->errorExits ) )
+				return readError( error, line, "bad error record" );
+		}
+		else {
+			return readError( error, line, "unknown record \"" + record + "\"" );
+		}
+	}
+
+	if ( !header )
+		return readError( error, line, "empty profile" );
+
+	if ( machine != 0 )
+		return readError( error, line, "machine " + machine->name + " has no end" );
+
+	return true;
+}
+
+const ProfileMachine *Profile::find( const std::string &name ) const
+{
+	for ( size_t m = 0; m < machines.size(); m++ ) {
+		if ( machines[m].name == name )
+			return &machines[m];
+	}
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Execution count of one transition, by state and key range. */
+struct ProfileTrans
+{
+	long state;
+	long long lowKey;
+	long long highKey;
+	unsigned long long count;
+};
+
+/* Execution counts of one machine, indexed by state id. */
+struct ProfileMachine
+{
+	ProfileMachine() : eofExits(0), errorExits(0) {}
+
+	std::string name;
+	std::vector<unsigned long long> states;
+	std::vector<ProfileTrans> trans;
+	std::vector<unsigned long long> actions;
+	unsigned long long eofExits;
+	unsigned long long errorExits;
+
+	/* State ids, most executed first. */
+	std::vector<long> hotOrder() const;
+
+	/* How many of the hottest states it takes to cover the given share of
+	 * all state executions. */
+	long hotStates( double share ) const;
+};
+
+/*
+ * Counts read back from instrumented generated code, given with
+ * --profile-use. The file is text, one record per line:
+ *
+ *   ragel-profile 1
+ *   machine NAME NUM-STATES
+ *   state ID COUNT
+ *   trans ID LOW-KEY HIGH-KEY COUNT
+ *   action ID COUNT
+ *   eof COUNT
+ *   error COUNT
+ *   end
+ *
+ * Records between machine and end belong to that machine. Counts are
+ * unsigned 64 bit, as written by contrib/ragel-profile.h.
+ */
+struct Profile
+{
+	/* Returns false and sets error on a malformed file. */
+	bool read( std::istream &in, std::string &error );
+
+	const ProfileMachine *find( const std::string &name ) const;
+
+	std::vector<ProfileMachine> machines;
+};
+
+#endif
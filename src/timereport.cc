@@ -0,0 +1,150 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timereport.h"
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+using std::endl;
+
+double timeNow()
+{
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void TimeReport::add( const std::string &section, const char *phase,
+		const std::string &name, double seconds, long states, long transitions )
+{
+	TimeEntry entry;
+	entry.section = section;
+	entry.phase = phase;
+	entry.name = name;
+	entry.seconds = seconds;
+	entry.states = states;
+	entry.transitions = transitions;
+
+	lock.lock();
+	entries.push_back( entry );
+	lock.unlock();
+}
+
+/* Entries are added in the order the steps finish, which is not fixed when
+ * sections are compiled in parallel. Within one section and definition the
+ * steps come from one thread, so a stable sort gives the same report on every
+ * run. */
+static bool entryBefore( const TimeEntry &a, const TimeEntry &b )
+{
+	if ( a.section != b.section )
+		return a.section < b.section;
+	return a.name < b.name;
+}
+
+void TimeReport::sortEntries()
+{
+	std::stable_sort( entries.begin(), entries.end(), entryBefore );
+}
+
+void TimeReport::writeText( std::ostream &out )
+{
+	sortEntries();
+
+	/* Formatted on the side, the stream may be shared with other reports. */
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(6);
+
+	double total = 0;
+	report << "time-report" << endl;
+	for ( std::vector<TimeEntry>::iterator te = entries.begin(); te != entries.end(); te++ ) {
+		report << std::setw(10) << te->seconds << "  ";
+		report << std::left << std::setw(18) << te->phase << std::right;
+
+		if ( te->section.size() > 0 )
+			report << te->section;
+		if ( te->name.size() > 0 )
+			report << ( te->section.size() > 0 ? "." : "" ) << te->name;
+
+		if ( te->states >= 0 )
+			report << "  states=" << te->states << " trans=" << te->transitions;
+		report << endl;
+
+		total += te->seconds;
+	}
+	report << std::setw(10) << total << "  total" << endl;
+
+	out << report.str();
+}
+
+static void writeJsonString( std::ostream &out, const std::string &s )
+{
+	out << '"';
+	for ( std::string::const_iterator c = s.begin(); c != s.end(); c++ ) {
+		switch ( *c ) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if ( (unsigned char)*c < 0x20 ) {
+					char buf[8];
+					sprintf( buf, "\\u%04x", (unsigned char)*c );
+					out << buf;
+				}
+				else {
+					out << *c;
+				}
+		}
+	}
+	out << '"';
+}
+
+void TimeReport::writeJson( std::ostream &out, const char *inputFileName )
+{
+	sortEntries();
+
+	out << "{\n  \"input\": ";
+	writeJsonString( out, inputFileName != 0 ? inputFileName : "" );
+	out << ",\n  \"entries\": [";
+
+	for ( size_t i = 0; i < entries.size(); i++ ) {
+		TimeEntry *te = &entries[i];
+		out << ( i == 0 ? "\n" : ",\n" ) << "    { \"section\": ";
+		writeJsonString( out, te->section );
+		out << ", \"phase\": ";
+		writeJsonString( out, te->phase );
+		out << ", \"definition\": ";
+		writeJsonString( out, te->name );
+		out << ", \"seconds\": " << std::fixed << std::setprecision(6) << te->seconds;
+		if ( te->states >= 0 ) {
+			out << ", \"states\": " << te->states <<
+					", \"transitions\": " << te->transitions;
+		}
+		out << " }";
+	}
+
+	out << "\n  ]\n}\n";
+}
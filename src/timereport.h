@@ -0,0 +1,64 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _TIMEREPORT_H
+#define _TIMEREPORT_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "workers.h"
+
+/* Wall clock time in seconds. */
+double timeNow();
+
+/* One timed step. States and transitions are -1 when the step does not
+ * produce a graph. */
+struct TimeEntry
+{
+	std::string section;
+	std::string phase;
+	std::string name;
+	double seconds;
+	long states;
+	long transitions;
+};
+
+/*
+ * Collects the time spent in each phase of a compile, per section and per
+ * top-level definition. Filled from the worker threads when sections are
+ * compiled in parallel.
+ */
+struct TimeReport
+{
+	void add( const std::string &section, const char *phase, const std::string &name,
+			double seconds, long states = -1, long transitions = -1 );
+
+	void sortEntries();
+	void writeText( std::ostream &out );
+	void writeJson( std::ostream &out, const char *inputFileName );
+
+	std::vector<TimeEntry> entries;
+	WorkLock lock;
+};
+
+#endif
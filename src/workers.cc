@@ -0,0 +1,219 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <libfsm/ragel.h>
+#include <libfsm/common.h>
+#include "workers.h"
+
+#if defined(HAVE_PTHREAD_H)
+static __thread std::ostream *captureBuffer = 0;
+#else
+static std::ostream *captureBuffer = 0;
+#endif
+
+/* Unbuffered, so every write is routed by the thread that makes it. */
+struct WorkCapture::Buf
+:
+	public std::streambuf
+{
+	Buf( std::streambuf *through ) : through(through) {}
+
+	std::streambuf *through;
+
+protected:
+	int overflow( int c )
+	{
+		if ( c == traits_type::eof() )
+			return traits_type::not_eof( c );
+		if ( captureBuffer != 0 ) {
+			captureBuffer->put( (char)c );
+			return c;
+		}
+		return through->sputc( (char)c );
+	}
+
+	std::streamsize xsputn( const char *s, std::streamsize n )
+	{
+		if ( captureBuffer != 0 ) {
+			captureBuffer->write( s, n );
+			return n;
+		}
+		return through->sputn( s, n );
+	}
+
+	int sync()
+	{
+		return captureBuffer != 0 ? 0 : through->pubsync();
+	}
+};
+
+WorkCapture::WorkCapture( std::ostream &os )
+:
+	os(os),
+	orig(os.rdbuf())
+{
+	buf = new Buf( orig );
+	os.rdbuf( buf );
+}
+
+WorkCapture::~WorkCapture()
+{
+	os.rdbuf( orig );
+	delete buf;
+}
+
+void WorkCapture::setThread( std::ostream *buffer )
+{
+	captureBuffer = buffer;
+}
+
+static void runSerial( const WorkItemVect &items )
+{
+	for ( WorkItemVect::Iter wi = items; wi.lte(); wi++ )
+		(*wi)->work();
+}
+
+#if defined(HAVE_PTHREAD_H)
+
+WorkLock::WorkLock()
+{
+	pthread_mutex_init( &mutex, 0 );
+}
+
+WorkLock::~WorkLock()
+{
+	pthread_mutex_destroy( &mutex );
+}
+
+void WorkLock::lock()
+{
+	pthread_mutex_lock( &mutex );
+}
+
+void WorkLock::unlock()
+{
+	pthread_mutex_unlock( &mutex );
+}
+
+/* Shared between the threads running one batch. Items are handed out in
+ * order, by position. */
+struct WorkBatch
+{
+	WorkBatch( const WorkItemVect &items )
+	:
+		items(items),
+		next(0),
+		aborted(false),
+		abortCode(0)
+	{
+		pthread_mutex_init( &mutex, 0 );
+	}
+
+	~WorkBatch()
+	{
+		pthread_mutex_destroy( &mutex );
+	}
+
+	const WorkItemVect &items;
+	long next;
+	bool aborted;
+	int abortCode;
+	pthread_mutex_t mutex;
+};
+
+static void *workerMain( void *arg )
+{
+	WorkBatch *batch = (WorkBatch*)arg;
+
+	while ( true ) {
+		long pos = -1;
+
+		pthread_mutex_lock( &batch->mutex );
+		if ( !batch->aborted && batch->next < batch->items.length() )
+			pos = batch->next++;
+		pthread_mutex_unlock( &batch->mutex );
+
+		if ( pos < 0 )
+			break;
+
+		try {
+			batch->items[pos]->work();
+		}
+		catch ( const AbortCompile &ac ) {
+			/* Cannot let the exception leave the thread. Record the first
+			 * abort and let the other workers drain. */
+			pthread_mutex_lock( &batch->mutex );
+			if ( !batch->aborted ) {
+				batch->aborted = true;
+				batch->abortCode = ac.code;
+			}
+			pthread_mutex_unlock( &batch->mutex );
+		}
+	}
+
+	return 0;
+}
+
+void runWorkItems( const WorkItemVect &items, int numWorkers )
+{
+	if ( numWorkers > items.length() )
+		numWorkers = items.length();
+
+	if ( numWorkers <= 1 ) {
+		runSerial( items );
+		return;
+	}
+
+	WorkBatch batch( items );
+
+	/* The calling thread is one of the workers. */
+	int numThreads = 0;
+	pthread_t *threads = new pthread_t[numWorkers - 1];
+	for ( int t = 0; t < numWorkers - 1; t++ ) {
+		if ( pthread_create( &threads[numThreads], 0, &workerMain, &batch ) == 0 )
+			numThreads += 1;
+	}
+
+	workerMain( &batch );
+
+	for ( int t = 0; t < numThreads; t++ )
+		pthread_join( threads[t], 0 );
+
+	delete[] threads;
+
+	if ( batch.aborted )
+		throw AbortCompile( batch.abortCode );
+}
+
+#else
+
+WorkLock::WorkLock() {}
+WorkLock::~WorkLock() {}
+void WorkLock::lock() {}
+void WorkLock::unlock() {}
+
+void runWorkItems( const WorkItemVect &items, int numWorkers )
+{
+	runSerial( items );
+}
+
+#endif
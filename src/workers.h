@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _WORKERS_H
+#define _WORKERS_H
+
+#include <libfsm/ragel.h>
+#include <iostream>
+#include "vector.h"
+
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
+/* A unit of work handed to the worker pool. Items in one batch must not
+ * modify state shared with other items in the batch. */
+struct WorkItem
+{
+	virtual ~WorkItem() {}
+	virtual void work() = 0;
+};
+
+typedef Vector<WorkItem*> WorkItemVect;
+
+/* Run a batch of work items on up to numWorkers threads, including the
+ * calling thread, and wait for all of them to finish. If there is only one
+ * worker, or threads are not available, the items are run in order on the
+ * calling thread. An AbortCompile thrown by an item stops the batch and is
+ * rethrown to the caller once all workers have stopped. */
+void runWorkItems( const WorkItemVect &items, int numWorkers );
+
+/* Protects state that work items share. Does nothing when threads are not
+ * available. */
+struct WorkLock
+{
+	WorkLock();
+	~WorkLock();
+
+	void lock();
+	void unlock();
+
+private:
+#if defined(HAVE_PTHREAD_H)
+	pthread_mutex_t mutex;
+#endif
+};
+
+/* Diverts what work items write to a stream. While a capture exists, a thread
+ * that has given itself a buffer with setThread writes there instead of to the
+ * stream. Other threads write through. Lets the caller replay the output of
+ * the items in item order once the batch is done. */
+struct WorkCapture
+{
+	WorkCapture( std::ostream &os );
+	~WorkCapture();
+
+	/* Set, or clear with null, the buffer of the calling thread. */
+	static void setThread( std::ostream *buffer );
+
+	struct Buf;
+
+private:
+	std::ostream &os;
+	std::streambuf *orig;
+	Buf *buf;
+};
+
+#endif
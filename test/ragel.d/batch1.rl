@@ -0,0 +1,92 @@
+/*
+ * @LANG: c
+ * @RAGEL_ARGS: --batch=working/batch1/manifest --graph-cache=working/batch1
+ * @PROHIBIT_FLAGS: -T1 -F0 -F1 -W0 -W1 -G0 -G1 -G2 -n -m -e --string-tables
+ */
+
+/**
+ * Compile two files as one batch with an on-disk graph cache. Both define
+ * the same word machine. The second file is generated into batch1/words.c,
+ * which is included here, so a batch that stops after the first file fails
+ * to build.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "batch1/words.c"
+
+struct batch1
+{
+	int cs;
+};
+
+%%{
+	machine batch1;
+	variable cs fsm->cs;
+
+	word = [a-z]+ ( '-' [a-z]+ )*;
+
+	main := word ( ' ' word )* '\n';
+}%%
+
+%% write data;
+
+void batch1_init( struct batch1 *fsm )
+{
+	%% write init;
+}
+
+void batch1_execute( struct batch1 *fsm, const char *_data, int _len )
+{
+	const char *p = _data;
+	const char *pe = _data+_len;
+
+	%% write exec;
+}
+
+int batch1_finish( struct batch1 *fsm )
+{
+	if ( fsm->cs == batch1_error )
+		return -1;
+	if ( fsm->cs >= batch1_first_final )
+		return 1;
+	return 0;
+}
+
+struct batch1 fsm;
+
+void test( const char *buf )
+{
+	int len = strlen( buf );
+	batch1_init( &fsm );
+	batch1_execute( &fsm, buf, len );
+	if ( batch1_finish( &fsm ) > 0 )
+		printf("ACCEPT\n");
+	else
+		printf("FAIL\n");
+}
+
+void test_words( const char *buf )
+{
+	if ( words_accept( buf ) )
+		printf("ACCEPT\n");
+	else
+		printf("FAIL\n");
+}
+
+int main()
+{
+	test( "one two-three\n" );
+	test( "one  two\n" );
+	test_words( "one,two-three\n" );
+	test_words( "one two\n" );
+
+	return 0;
+}
+
+##### OUTPUT #####
+ACCEPT
+FAIL
+ACCEPT
+FAIL
@@ -0,0 +1,25 @@
+/*
+ * Second file of the batch1 test. Shares the word definition with batch1.rl.
+ */
+
+%%{
+	machine words;
+
+	word = [a-z]+ ( '-' [a-z]+ )*;
+
+	main := word ',' word '\n';
+}%%
+
+%% write data;
+
+int words_accept( const char *buf )
+{
+	int cs;
+	const char *p = buf;
+	const char *pe = buf + strlen( buf );
+
+	%% write init;
+	%% write exec;
+
+	return cs >= words_first_final;
+}
@@ -8,6 +8,9 @@
 #
 #    @RAGEL_FILE: file name to pass on the command line instead of file created
 #    by extracting section. Does not work with translated test cases.
+#
+#    @RAGEL_ARGS: additional arguments to pass to ragel, ahead of the output
+#    and input file names.
 # 
 
 TRANS=./trans
@@ -318,7 +321,7 @@ function run_test()
 	classname=`echo $lroot$gen_opt | sed 's/-\+/_/g'`
 
 	opts="$gen_opt $min_opt $enc_opt $f_opt"
-	args="-I. $opts -o $code_src $translated"
+	args="-I. $opts $RAGEL_ARGS -o $code_src $translated"
 
 	cat >> $sh <<-EOF
 	echo testing $lroot $opts
@@ -413,6 +416,9 @@ function run_translate()
 	# Override the test case file name.
 	RAGEL_FILE=`sed '/@RAGEL_FILE:/s/^.*: *//p;d' $test_case`
 
+	# Additional arguments for ragel.
+	RAGEL_ARGS=`sed '/@RAGEL_ARGS:/s/^.*: *//p;d' $test_case`
+
 	# Filter to pass output through. Shell code.
 	FILTER=`sed '/@FILTER:/s/^.*: *//p;d' $test_case`
 
@@ -0,0 +1,68 @@
+/*
+ * @LANG: indep
+ */
+
+/**
+ * A long union of literals, mixing case-insensitive and plain strings that
+ * share prefixes, and broken up by a term that is not a literal.
+ */
+%%{
+	machine litunion1;
+
+	main := (
+		'if' | 'else' | 'elif' | [0-9]+ |
+		'while'i | 'WHEN' | 'wh' | 'for'i | 'fo' |
+		'x' | 'Xy'i | 'do' | 'DONE'i | 'default'
+	) '\n';
+}%%
+
+##### INPUT #####
+"if\n"
+"IF\n"
+"else\n"
+"elif\n"
+"el\n"
+"123\n"
+"WhIlE\n"
+"when\n"
+"WHEN\n"
+"wh\n"
+"WH\n"
+"FoR\n"
+"fo\n"
+"FO\n"
+"x\n"
+"X\n"
+"xy\n"
+"XY\n"
+"do\n"
+"DO\n"
+"done\n"
+"default\n"
+"DEFAULT\n"
+"\n"
+##### OUTPUT #####
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+FAIL
@@ -0,0 +1,101 @@
+/*
+ * @LANG: c
+ */
+
+/**
+ * Or-blocks whose ranges touch or overlap, at the ends of the alphabet.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+struct orblock
+{
+	int cs;
+};
+
+%%{
+	machine orblock;
+	variable cs fsm->cs;
+
+	alphtype unsigned char;
+
+	main := (
+		( 'a' [\0-\a\b-\n] ) |
+		( 'b' [\0-\n\t-\r] ) |
+		( 'c' [^\0-\t\n-~] ) |
+		( 'd' [\0\0-\0\0] )
+	) ';';
+}%%
+
+%% write data;
+
+void orblock_init( struct orblock *fsm )
+{
+	%% write init;
+}
+
+void orblock_execute( struct orblock *fsm, const unsigned char *_data, int _len )
+{
+	const unsigned char *p = _data;
+	const unsigned char *pe = _data+_len;
+
+	%% write exec;
+}
+
+int orblock_finish( struct orblock *fsm )
+{
+	if ( fsm->cs == orblock_error )
+		return -1;
+	if ( fsm->cs >= orblock_first_final )
+		return 1;
+	return 0;
+}
+
+struct orblock fsm;
+
+void test( const char *buf, int len )
+{
+	orblock_init( &fsm );
+	orblock_execute( &fsm, (const unsigned char*)buf, len );
+	if ( orblock_finish( &fsm ) > 0 )
+		printf("ACCEPT\n");
+	else
+		printf("FAIL\n");
+}
+
+int main()
+{
+	test( "a\x00;", 3 );
+	test( "a\x07;", 3 );
+	test( "a\x08;", 3 );
+	test( "a\n;", 3 );
+	test( "a\x0b;", 3 );
+	test( "b\x00;", 3 );
+	test( "b\r;", 3 );
+	test( "b\x0e;", 3 );
+	test( "c\x7f;", 3 );
+	test( "c\xff;", 3 );
+	test( "c~;", 3 );
+	test( "c\x00;", 3 );
+	test( "d\x00;", 3 );
+	test( "d\x01;", 3 );
+
+	return 0;
+}
+
+##### OUTPUT #####
+ACCEPT
+ACCEPT
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+FAIL
+ACCEPT
+FAIL
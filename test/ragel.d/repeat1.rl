@@ -0,0 +1,103 @@
+/*
+ * @LANG: indep
+ */
+
+/**
+ * Bounded repetition, with and without out actions pending on the final
+ * states of the repeated machine. Where a copy has both, the leaving action
+ * of one copy runs before the entering action of the next.
+ */
+%%{
+	machine repeat1;
+
+	action A { print_str "A\n"; }
+	action B { print_str "B\n"; }
+
+	w = 'ab';
+	p = 'x' %A;
+	q = 'x' >A %B;
+
+	main := (
+		( '1' w{5} ) |
+		( '2' w{,3} ) |
+		( '3' w{2,4} ) |
+		( '4' p{3} ) |
+		( '5' p{,2} ) |
+		( '6' p{1,3} ) |
+		( '7' q{3} ) |
+		( '8' q{1,2} )
+	) '\n';
+}%%
+
+##### INPUT #####
+"1ababababab\n"
+"1abababab\n"
+"1abababababab\n"
+"2\n"
+"2ababab\n"
+"2abababab\n"
+"3ab\n"
+"3abab\n"
+"3abababab\n"
+"3ababababab\n"
+"4xxx\n"
+"4xx\n"
+"5\n"
+"5xx\n"
+"5xxx\n"
+"6\n"
+"6x\n"
+"6xxx\n"
+"6xxxx\n"
+"7xxx\n"
+"7xx\n"
+"8xx\n"
+##### OUTPUT #####
+ACCEPT
+FAIL
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+FAIL
+ACCEPT
+ACCEPT
+FAIL
+A
+A
+A
+ACCEPT
+A
+FAIL
+ACCEPT
+A
+A
+ACCEPT
+A
+FAIL
+FAIL
+A
+ACCEPT
+A
+A
+A
+ACCEPT
+A
+A
+FAIL
+A
+B
+A
+B
+A
+B
+ACCEPT
+A
+B
+A
+FAIL
+A
+B
+A
+B
+ACCEPT
@@ -0,0 +1,46 @@
+/*
+ * @LANG: indep
+ * @NEEDS_EOF: yes
+ */
+
+ptr ts;
+ptr te;
+int act;
+int token;
+
+%%{
+	machine scanner;
+
+	# Tokens that overlap. The longest match wins, ties go to the pattern
+	# given first.
+	main := |*
+		'a' => {
+			print_str "a\n";
+		};
+		'ab' => {
+			print_str "ab\n";
+		};
+		'abc' => {
+			print_str "abc\n";
+		};
+		[a-c]+ => {
+			print_str "word\n";
+		};
+		' ';
+	*|;
+}%%
+
+##### INPUT #####
+"a ab abc abcc b ca"
+"aba abca"
+##### OUTPUT #####
+a
+ab
+abc
+word
+word
+word
+ACCEPT
+word
+word
+ACCEPT